@@ -2,6 +2,7 @@
 #define BASE_ROBOT_POSITIONER_IMH4RD8H
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 #include <gazebo_msgs/GetModelState.h>
 #include <gazebo_msgs/SetModelState.h>
 #include <bwi_mapper/point_utils.h>
@@ -11,10 +12,13 @@
 #include <nav_msgs/Odometry.h>
 #include <opencv/cv.h>
 #include <ros/ros.h>
+#include <set>
 
 #include <bwi_guidance/experiment.h>
+#include <bwi_guidance/graph_spatial_index.h>
 #include <bwi_guidance/robot_screen_publisher.h>
 #include <bwi_guidance/robots.h>
+#include <bwi_guidance/teleport_scheduler.h>
 #include <bwi_guidance_msgs/ExperimentStatus.h>
 
 namespace bwi_guidance {
@@ -41,16 +45,37 @@ namespace bwi_guidance {
       bool teleportEntity(const std::string& entity, 
           const geometry_msgs::Pose& pose);
 
+      /* Pose for a robot at "at", out of the way of a person walking from
+       * "from" through "at" to "to". Results are cached. */
       geometry_msgs::Pose positionRobot(
           const bwi_mapper::Point2f& from,
           const bwi_mapper::Point2f& at,
           const bwi_mapper::Point2f& to);
 
       void start();
+
+      /* Teleports robots and publishes their state whenever a robot is
+       * changed through setRobotLocation() or setRobotScreenOrientation(),
+       * and services ROS callbacks on a separate thread meanwhile. */
       void run();
 
     protected:
 
+      /* Robot state changes. Both must be called with
+       * robot_modification_mutex_ held. Changed robots are marked dirty, and
+       * run() is woken up to handle them. */
+      void setRobotLocation(const std::string& robot_id,
+          const geometry_msgs::Pose& pose);
+      void setRobotScreenOrientation(const std::string& robot_id,
+          float orientation);
+
+      /* found is false if there is no free cell near "at", in which case
+       * the pose is at the map origin */
+      geometry_msgs::Pose searchRobotPosition(
+          const bwi_mapper::Point2f& from,
+          const bwi_mapper::Point2f& at,
+          const bwi_mapper::Point2f& to, bool& found);
+
       boost::shared_ptr<ros::NodeHandle> nh_;
       boost::shared_ptr<boost::thread> publishing_thread_;
 
@@ -59,11 +84,13 @@ namespace bwi_guidance {
       ros::Publisher position_publisher_;
       ros::ServiceClient get_gazebo_model_client_;
       ros::ServiceClient set_gazebo_model_client_;
+      boost::shared_ptr<TeleportScheduler> teleport_scheduler_;
 
       bool debug_;
       double search_distance_;
       boost::shared_ptr<bwi_mapper::MapLoader> mapper_;
       bwi_mapper::Graph graph_;
+      boost::shared_ptr<GraphSpatialIndex> graph_index_;
       nav_msgs::OccupancyGrid map_;
       nav_msgs::OccupancyGrid inflated_map_;
       nav_msgs::MapMetaData map_info_;
@@ -82,8 +109,25 @@ namespace bwi_guidance {
       std::map<std::string, bool> robot_ok_;
       boost::mutex robot_modification_mutex_;
 
+      // Robots changed since run() last handled them, and whether the
+      // instance status changed. Guarded by robot_modification_mutex_.
+      std::set<std::string> dirty_robots_;
+      bool status_dirty_;
+      boost::condition_variable robots_changed_;
+
+      /* The (from, at, to) points given to positionRobot. They are derived
+       * from graph vertices, so the same ones repeat across instances. */
+      struct PlacementKey {
+        float from_x, from_y, at_x, at_y, to_x, to_y;
+        bool operator<(const PlacementKey& other) const;
+      };
+      std::map<PlacementKey, geometry_msgs::Pose> placement_cache_;
+      boost::mutex placement_cache_mutex_;
+
       int current_instance_;
-      bool instance_in_progress_;
+      // Only written by the callback thread, and read by other threads as a
+      // hint. Derived classes synchronize their own instance state.
+      volatile bool instance_in_progress_;
       bool prev_msg_ready_;
       ros::Subscriber experiment_status_subscriber_;
 
@@ -0,0 +1,73 @@
+#ifndef GRAPH_SPATIAL_INDEX_T3W8QX1N
+#define GRAPH_SPATIAL_INDEX_T3W8QX1N
+
+#include <cstddef>
+#include <vector>
+
+#include <bwi_mapper/graph.h>
+#include <bwi_mapper/point_utils.h>
+
+namespace bwi_guidance {
+
+  /* Uniform grid over the vertices and edge segments of a graph, in map
+   * pixel coordinates. Nearest vertex and nearest edge queries only visit
+   * the grid cells around the query point, so their cost does not grow with
+   * the size of the graph. The graph must not change after construction. */
+  class GraphSpatialIndex {
+
+    public:
+
+      /* cell_size in pixels. 0 picks the mean edge length. */
+      GraphSpatialIndex(const bwi_mapper::Graph& graph, float cell_size = 0.0f);
+
+      /* Id of the vertex closest to point, or -1 if no vertex is within
+       * threshold pixels (0 for no threshold). */
+      size_t getClosestVertex(const bwi_mapper::Point2f& point,
+          float threshold = 0.0f) const;
+
+      /* Edge (u, v) closest to point, with its distance in pixels. Returns
+       * false if the graph has no edges. */
+      bool getClosestEdge(const bwi_mapper::Point2f& point, size_t& u,
+          size_t& v, float& distance) const;
+
+      /* The vertex of the closest edge that is closer to toward, which is
+       * how a location is snapped to the graph when the direction of travel
+       * is known (as for the start and goal of an instance). Returns -1 if
+       * the graph has no edges. */
+      size_t getClosestIdOnEdgeToward(const bwi_mapper::Point2f& point,
+          const bwi_mapper::Point2f& toward) const;
+
+      inline const bwi_mapper::Graph& getGraph() const { return graph_; }
+
+    private:
+
+      struct Edge {
+        size_t u, v;
+        bwi_mapper::Point2f from, to;
+      };
+
+      void getCell(const bwi_mapper::Point2f& point, int& x, int& y) const;
+      inline size_t getCellIdx(int x, int y) const {
+        return y * width_ + x;
+      }
+
+      /* Visits the cells in square rings of growing radius around point,
+       * until no cell further out can be closer than the best found so far.
+       * Every item in a visited cell is passed to Query::consider(). */
+      template <class Query>
+      void searchRings(const bwi_mapper::Point2f& point,
+          const std::vector<std::vector<size_t> >& cells, Query& query) const;
+
+      const bwi_mapper::Graph& graph_;
+      std::vector<Edge> edges_;
+      float cell_size_;
+      bwi_mapper::Point2f origin_;
+      int width_, height_;
+      std::vector<std::vector<size_t> > vertex_cells_;
+      std::vector<std::vector<size_t> > edge_cells_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: GRAPH_SPATIAL_INDEX_T3W8QX1N */
@@ -0,0 +1,85 @@
+#ifndef GRAPH_TRACKER_R5N2VJ8C
+#define GRAPH_TRACKER_R5N2VJ8C
+
+#include <cstddef>
+#include <vector>
+
+#include <bwi_guidance/graph_spatial_index.h>
+
+namespace bwi_guidance {
+
+  /* Follows a person along the graph from successive location observations
+   * (in map pixel coordinates). The tracker keeps the vertex the person is
+   * at, and their position on an edge leaving it: precision is the fraction
+   * of the edge from getCurrentVertex() to getNextVertex() covered so far,
+   * as with StateIROS14::from_graph_node, graph_id and precision. An update
+   * only looks at the edges of the current vertex, so it takes constant
+   * time for graphs of bounded degree.
+   *
+   * The current vertex changes once the person is past the middle of the
+   * edge by more than hysteresis pixels (but at most a quarter of the edge),
+   * so that noisy observations near the middle of an edge do not cause
+   * back and forth transitions. If the person is further than
+   * relocalize_distance pixels from all the edges of the current vertex
+   * (0 to never relocalize), they are snapped to the closest edge of the
+   * whole graph using the spatial index instead. */
+  class GraphTracker {
+
+    public:
+
+      GraphTracker(const GraphSpatialIndex& graph_index,
+          float hysteresis = 10.0f, float relocalize_distance = 0.0f);
+
+      /* Places the person at vertex, with no progress along any edge */
+      void reset(size_t vertex);
+
+      /* Returns true if the current vertex changed. Every vertex the person
+       * moved to is appended to transitions, in order, as a single
+       * observation can be past more than one edge midpoint. */
+      bool update(const bwi_mapper::Point2f& point,
+          std::vector<size_t>& transitions);
+
+      inline size_t getCurrentVertex() const { return current_vertex_; }
+      inline size_t getNextVertex() const { return next_vertex_; }
+      inline float getPrecision() const { return precision_; }
+
+      /* Distance in pixels from the last observation to the current edge */
+      inline float getDistanceFromEdge() const { return distance_; }
+
+    private:
+
+      /* Edge from a vertex to one of its neighbours */
+      struct Edge {
+        size_t to;
+        bwi_mapper::Point2f from_loc;
+        bwi_mapper::Point2f direction; // to location - from location
+        float squared_length;
+        float transition_precision;
+      };
+
+      /* Projects point on edge. Returns the squared distance to it. */
+      float project(const Edge& edge, const bwi_mapper::Point2f& point,
+          float& precision) const;
+
+      /* Closest edge of the current vertex, false if it has none */
+      bool findClosestEdge(const bwi_mapper::Point2f& point, 
+          const Edge*& closest_edge, float& precision,
+          float& squared_distance) const;
+
+      void relocalize(const bwi_mapper::Point2f& point,
+          std::vector<size_t>& transitions);
+
+      const GraphSpatialIndex& graph_index_;
+      float relocalize_distance_;
+      std::vector<std::vector<Edge> > edges_; // by source vertex
+
+      size_t current_vertex_;
+      size_t next_vertex_;
+      float precision_;
+      float distance_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: GRAPH_TRACKER_R5N2VJ8C */
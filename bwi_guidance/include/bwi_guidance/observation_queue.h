@@ -0,0 +1,63 @@
+#ifndef OBSERVATION_QUEUE_Q7K2M9P4
+#define OBSERVATION_QUEUE_Q7K2M9P4
+
+#include <cstddef>
+#include <vector>
+
+namespace bwi_guidance {
+
+  /* Bounded lock-free FIFO for exactly one producer thread (typically a ROS
+   * callback) and one consumer thread. push() never blocks, and fails when
+   * the queue is full. */
+  template <typename T>
+  class ObservationQueue {
+
+    public:
+
+      explicit ObservationQueue(std::size_t capacity = 64) :
+        buffer_(capacity + 1), head_(0), tail_(0) {}
+
+      /* Producer only */
+      bool push(const T& value) {
+        std::size_t tail = tail_;
+        std::size_t next = (tail + 1) % buffer_.size();
+        if (next == head_) {
+          return false;
+        }
+        // Do not overwrite the slot before the consumer is done with it
+        __sync_synchronize();
+        buffer_[tail] = value;
+        // Publish the value before the new tail
+        __sync_synchronize();
+        tail_ = next;
+        return true;
+      }
+
+      /* Consumer only */
+      bool pop(T& value) {
+        std::size_t head = head_;
+        if (head == tail_) {
+          return false;
+        }
+        __sync_synchronize();
+        value = buffer_[head];
+        // Finish reading the value before releasing its slot
+        __sync_synchronize();
+        head_ = (head + 1) % buffer_.size();
+        return true;
+      }
+
+      /* Only a snapshot when called concurrently */
+      inline bool empty() const { return head_ == tail_; }
+
+    private:
+
+      std::vector<T> buffer_;
+      volatile std::size_t head_; // next value to pop, written by the consumer
+      volatile std::size_t tail_; // next free slot, written by the producer
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: OBSERVATION_QUEUE_Q7K2M9P4 */
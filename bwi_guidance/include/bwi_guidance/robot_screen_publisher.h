@@ -3,6 +3,7 @@
 
 #include <opencv/cv.h>
 #include <ros/ros.h>
+#include <sensor_msgs/Image.h>
 #include <map>
 #include <string>
 #include <boost/shared_ptr.hpp>
@@ -10,26 +11,46 @@
 
 namespace bwi_guidance {
 
+  /* Publishes the screen image of every robot. An image is converted to a
+   * message once, when it changes, and published right away. The last
+   * message of every robot is published again every keepalive_period 
+   * seconds, for subscribers that connect later. */
   class RobotScreenPublisher {
 
     public:
 
-      RobotScreenPublisher(boost::shared_ptr<ros::NodeHandle>& nh);
+      RobotScreenPublisher(boost::shared_ptr<ros::NodeHandle>& nh,
+          float keepalive_period = 1.0f);
       ~RobotScreenPublisher();
 
       void addRobot(const std::string& robot_id);
+
+      /* Images are compared by their pixel buffer, so the same image can 
+       * be passed repeatedly at no cost, but an image must not be modified 
+       * in place once it has been passed. */
       void updateImage(const std::string& robot_id, const cv::Mat& image);
       void start();
 
     private:
 
+      struct RobotScreen {
+        ros::Publisher publisher;
+        cv::Mat image;
+        sensor_msgs::ImageConstPtr message;
+        bool changed;
+      };
+
       void run();
+      void setImage(const std::string& robot_id, RobotScreen& screen,
+          const cv::Mat& image);
 
       boost::shared_ptr<boost::thread> publishing_thread_;
       boost::shared_ptr<ros::NodeHandle>& nh_;
-      std::map<std::string, ros::Publisher> robot_image_publisher_;
-      std::map<std::string, cv::Mat> robot_image_;
-      std::map<std::string, boost::shared_ptr<boost::mutex> > robot_image_lock_;
+      float keepalive_period_;
+
+      std::map<std::string, RobotScreen> robot_screens_;
+      boost::mutex robot_screens_mutex_;
+      boost::condition_variable screen_changed_;
 
   };
 } /* bwi_guidance */
@@ -0,0 +1,98 @@
+#ifndef TELEPORT_SCHEDULER_H8PZ4KW2
+#define TELEPORT_SCHEDULER_H8PZ4KW2
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/Pose.h>
+#include <ros/ros.h>
+
+namespace bwi_guidance {
+
+  /* True if the poses are within 5 cm and 0.1 rad of each other */
+  bool checkClosePoses(const geometry_msgs::Pose& p1,
+      const geometry_msgs::Pose& p2);
+
+  /* Reads and sets the pose of simulated models. Implementations must 
+   * allow concurrent calls. */
+  class ModelStateService {
+    public:
+      virtual ~ModelStateService() {}
+      virtual bool getModelPose(const std::string& entity, 
+          geometry_msgs::Pose& pose) = 0;
+      virtual bool setModelPose(const std::string& entity,
+          const geometry_msgs::Pose& pose) = 0;
+  };
+
+  /* Uses the gazebo/get_model_state and gazebo/set_model_state services.
+   * Every call uses its own service client, so that calls from different
+   * threads do not share a connection. */
+  class GazeboModelStateService : public ModelStateService {
+    public:
+      GazeboModelStateService(boost::shared_ptr<ros::NodeHandle>& nh);
+      virtual bool getModelPose(const std::string& entity, 
+          geometry_msgs::Pose& pose);
+      virtual bool setModelPose(const std::string& entity,
+          const geometry_msgs::Pose& pose);
+    private:
+      boost::shared_ptr<ros::NodeHandle> nh_;
+  };
+
+  struct TeleportResult {
+    bool success;
+    unsigned int attempts;
+    float latency; // seconds from the start of the batch until verified
+  };
+
+  /* Teleports batches of entities with a pool of worker threads. Each
+   * entity is set to its pose and then verified, up to a number of
+   * attempts. Entities are handled concurrently, so that a batch takes
+   * about as long as its slowest entity instead of the sum over all of
+   * them, as long as there are enough workers. */
+  class TeleportScheduler {
+
+    public:
+
+      TeleportScheduler(const boost::shared_ptr<ModelStateService>& service,
+          unsigned int num_workers = 8, unsigned int attempts = 5);
+      ~TeleportScheduler();
+
+      /* Blocks until every entity is verified at its pose or out of 
+       * attempts. results[i] is the outcome for entities[i]. Only one batch
+       * can be in progress at a time. */
+      void teleport(const std::vector<std::string>& entities,
+          const std::vector<geometry_msgs::Pose>& poses,
+          std::vector<TeleportResult>& results);
+
+    private:
+
+      void runWorker();
+      TeleportResult teleportEntity(const std::string& entity,
+          const geometry_msgs::Pose& pose,
+          const boost::posix_time::ptime& batch_start);
+
+      boost::shared_ptr<ModelStateService> service_;
+      unsigned int attempts_;
+      boost::thread_group workers_;
+
+      // Current batch. Workers take the indices of its entities from jobs_.
+      boost::mutex batch_mutex_;
+      boost::condition_variable job_available_;
+      boost::condition_variable batch_done_;
+      const std::vector<std::string>* entities_;
+      const std::vector<geometry_msgs::Pose>* poses_;
+      std::vector<TeleportResult>* results_;
+      boost::posix_time::ptime batch_start_;
+      std::deque<size_t> jobs_;
+      size_t jobs_remaining_;
+      bool stop_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: TELEPORT_SCHEDULER_H8PZ4KW2 */
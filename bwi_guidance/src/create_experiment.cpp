@@ -42,6 +42,8 @@
 #include <bwi_mapper/point_utils.h>
 #include <bwi_mapper/graph.h>
 
+#include <bwi_guidance/graph_spatial_index.h>
+
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
@@ -65,52 +67,11 @@ int highlight_idx = -1;
 
 void findStartAndGoalIdx(bwi_mapper::Point2f start, 
     bwi_mapper::Point2f goal, 
-    bwi_mapper::Graph &graph, size_t &start_idx, size_t &goal_idx) {
-
-  boost::property_map<bwi_mapper::Graph, boost::vertex_index_t>::type 
-      indexmap = boost::get(boost::vertex_index, graph);
-
-  float start_fitness = std::numeric_limits<float>::max();
-  float goal_fitness = std::numeric_limits<float>::max();
-
-  bwi_mapper::Graph::vertex_iterator vi, vend;
-  for (boost::tie(vi, vend) = boost::vertices(graph); vi != vend; ++vi) {
-    bwi_mapper::Point2f& loc = graph[*vi].location;
-    bwi_mapper::Graph::adjacency_iterator ai, aend;
-    for (boost::tie(ai, aend) = boost::adjacent_vertices(
-          (bwi_mapper::Graph::vertex_descriptor)*vi, graph); 
-        ai != aend; ++ai) {
-      bwi_mapper::Point2f& loc2 = graph[*ai].location;
-
-      // Improve start idx as necessary
-      float start_distance = 
-          bwi_mapper::minimumDistanceToLineSegment(loc, loc2, start);
-      if (start_distance < start_fitness) {
-        start_fitness = start_distance;
-        if (bwi_mapper::getMagnitude(loc - goal) < 
-            bwi_mapper::getMagnitude(loc2 - goal)) {
-          start_idx = indexmap[*vi];
-        } else {
-          start_idx = indexmap[*ai];
-        }
-      }
-
-      // Improve goal idx as necessary
-      float goal_distance = 
-          bwi_mapper::minimumDistanceToLineSegment(loc, loc2, goal);
-      if (goal_distance < goal_fitness) {
-        goal_fitness = goal_distance;
-        if (bwi_mapper::getMagnitude(loc - start) < 
-            bwi_mapper::getMagnitude(loc2 - start)) {
-          goal_idx = indexmap[*vi];
-        } else {
-          goal_idx = indexmap[*ai];
-        }
-      }
-
-    }
-  }
-
+    const bwi_guidance::GraphSpatialIndex& graph_index, size_t &start_idx,
+    size_t &goal_idx) {
+  // Snap each end to the vertex of its closest edge that faces the other end
+  start_idx = graph_index.getClosestIdOnEdgeToward(start, goal);
+  goal_idx = graph_index.getClosestIdOnEdgeToward(goal, start);
 }
 
 void circleIdx(cv::Mat& image, bwi_mapper::Graph& graph, 
@@ -159,6 +120,7 @@ int main(int argc, char** argv) {
   nav_msgs::MapMetaData info;
   mapper.getMapInfo(info);
   bwi_mapper::readGraphFromFile(argv[2], info, graph);
+  bwi_guidance::GraphSpatialIndex graph_index(graph);
 
   cv::Mat image;
 
@@ -225,7 +187,7 @@ int main(int argc, char** argv) {
     // Highlight
     if (global_state == ROBOTS || global_state == GOAL_PATH) {
       size_t highlight_idx = 
-          bwi_mapper::getClosestIdOnGraph(mouseover_pt, graph);
+          graph_index.getClosestVertex(mouseover_pt);
       if (highlight_idx != (size_t) -1) {
         highlightIdx(image, graph, highlight_idx); 
       }
@@ -269,7 +231,7 @@ int main(int argc, char** argv) {
           map_goal = map_pt; pxl_goal = clicked_pt; 
           ss << "  ball_x: " << map_pt.x << std::endl;
           ss << "  ball_y: " << map_pt.y << std::endl;
-          // findStartAndGoalIdx(pxl_start, pxl_goal, graph, start_idx, goal_idx);
+          // findStartAndGoalIdx(pxl_start, pxl_goal, graph_index, start_idx, goal_idx);
           // bwi_mapper::getShortestPathWithDistance(graph, start_idx, goal_idx, path_idx);
           global_state = GOAL_PATH;
           break;
@@ -317,7 +279,7 @@ int main(int argc, char** argv) {
       }
       increment_state = false;
     } else if (new_path_point_available) {
-      size_t idx = bwi_mapper::getClosestIdOnGraph(clicked_pt, graph);
+      size_t idx = graph_index.getClosestVertex(clicked_pt);
       if (idx != (size_t)-1) {
         if (path_idx.size() == 0) {
           path_idx.push_back(idx);
@@ -333,7 +295,7 @@ int main(int argc, char** argv) {
       new_path_point_available = false;
     } else if (new_robot_available) {
       if (global_state == ROBOTS) {
-        size_t idx = bwi_mapper::getClosestIdOnGraph(clicked_pt, graph);
+        size_t idx = graph_index.getClosestVertex(clicked_pt);
         if (idx != (size_t)-1) {
           if (std::find(path_idx.begin(), path_idx.end(), idx) != path_idx.end()) {
             robot_idx.push_back(idx);
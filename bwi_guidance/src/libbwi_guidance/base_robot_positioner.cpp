@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <boost/foreach.hpp>
+#include <cmath>
 #include <cstdlib>
+#include <vector>
 #include <ros/ros.h>
 #include <ros/package.h>
 #include <opencv/highgui.h>
@@ -59,6 +61,7 @@ namespace bwi_guidance {
     bwi_mapper::inflateMap(robot_radius + robot_padding, 
         map_, inflated_map_);
     bwi_mapper::readGraphFromFile(graph_file, map_info_, graph_);
+    graph_index_.reset(new GraphSpatialIndex(graph_));
     
     readDefaultRobotsFromFile(robot_file, default_robots_);
     BOOST_FOREACH(const Robot& robot, default_robots_.robots) {
@@ -88,6 +91,12 @@ namespace bwi_guidance {
 
     if (gazebo_available_) {
       ROS_INFO_STREAM("Gazebo is AVAILABLE");
+      int teleport_threads;
+      private_nh.param<int>("teleport_threads", teleport_threads, 8);
+      boost::shared_ptr<ModelStateService> model_state_service(
+          new GazeboModelStateService(nh));
+      teleport_scheduler_.reset(
+          new TeleportScheduler(model_state_service, teleport_threads));
     } else {
       ROS_INFO_STREAM("Gazebo is NOT AVAILABLE");
     }
@@ -102,6 +111,7 @@ namespace bwi_guidance {
           1, &BaseRobotPositioner::experimentCallback, this);
 
     prev_msg_ready_ = false;
+    status_dirty_ = false;
     position_publisher_ = 
       nh->advertise<bwi_guidance_msgs::RobotInfoArray>("robot_positions", 1, true);
   }
@@ -115,14 +125,33 @@ namespace bwi_guidance {
   void BaseRobotPositioner::finalizeExperimentInstance() {
     boost::mutex::scoped_lock lock(robot_modification_mutex_);
     BOOST_FOREACH(const Robot& robot, default_robots_.robots) {
-      robot_locations_[robot.id] = 
-        convert2dToPose(robot.default_loc.x, robot.default_loc.y, 0);
-      robot_screen_orientations_[robot.id] = 
-        std::numeric_limits<float>::quiet_NaN(); 
+      setRobotLocation(robot.id, 
+          convert2dToPose(robot.default_loc.x, robot.default_loc.y, 0));
+      setRobotScreenOrientation(robot.id, 
+          std::numeric_limits<float>::quiet_NaN()); 
       robot_screen_publisher_.updateImage(robot.id, blank_image_);
     }
   }
 
+  void BaseRobotPositioner::setRobotLocation(const std::string& robot_id,
+      const geometry_msgs::Pose& pose) {
+    robot_locations_[robot_id] = pose;
+    dirty_robots_.insert(robot_id);
+    robots_changed_.notify_one();
+  }
+
+  void BaseRobotPositioner::setRobotScreenOrientation(
+      const std::string& robot_id, float orientation) {
+    float& current_orientation = robot_screen_orientations_[robot_id];
+    if ((std::isnan(current_orientation) && std::isnan(orientation)) ||
+        current_orientation == orientation) {
+      return;
+    }
+    current_orientation = orientation;
+    dirty_robots_.insert(robot_id);
+    robots_changed_.notify_one();
+  }
+
   void BaseRobotPositioner::produceDirectedArrowAlt(float orientation,
       cv::Mat& image) {
 
@@ -217,7 +246,12 @@ namespace bwi_guidance {
     } else if (!es->robot_positioning_enabled && instance_in_progress_) {
       finalizeExperimentInstance();
       instance_in_progress_ = false;
+    } else {
+      return;
     }
+    boost::mutex::scoped_lock lock(robot_modification_mutex_);
+    status_dirty_ = true;
+    robots_changed_.notify_one();
   }
 
   geometry_msgs::Pose BaseRobotPositioner::convert2dToPose(
@@ -232,16 +266,7 @@ namespace bwi_guidance {
 
   bool BaseRobotPositioner::checkClosePoses(const geometry_msgs::Pose& p1,
       const geometry_msgs::Pose& p2) {
-    if (fabs(p1.position.x - p2.position.x) > 0.05 ||
-        fabs(p1.position.y - p2.position.y) > 0.05) {
-      return false;
-    }
-    double yaw1 = tf::getYaw(p1.orientation);
-    double yaw2 = tf::getYaw(p2.orientation);
-    if (fabs(yaw1 - yaw2) > 0.1) {
-      return false;
-    }
-    return true;
+    return bwi_guidance::checkClosePoses(p1, p2);
   }
 
   bool BaseRobotPositioner::teleportEntity(const std::string& entity,
@@ -252,38 +277,92 @@ namespace bwi_guidance {
       return false;
     }
 
-    int count = 0;
-    int attempts = 5;
-    bool location_verified = false;
-    while (count < attempts and !location_verified) {
-      gazebo_msgs::GetModelState get_srv;
-      get_srv.request.model_name = entity;
-      get_gazebo_model_client_.call(get_srv);
-      location_verified = checkClosePoses(get_srv.response.pose, pose);
-      if (!location_verified) {
-        gazebo_msgs::SetModelState set_srv;
-        set_srv.request.model_state.model_name = entity;
-        set_srv.request.model_state.pose = pose;
-        set_gazebo_model_client_.call(set_srv);
-        if (!set_srv.response.success) {
-          ROS_WARN_STREAM("SetModelState service call failed for " << entity
-              << " to " << pose);
+    std::vector<std::string> entities(1, entity);
+    std::vector<geometry_msgs::Pose> poses(1, pose);
+    std::vector<TeleportResult> results;
+    teleport_scheduler_->teleport(entities, poses, results);
+    return results[0].success;
+  }
+
+  namespace {
+
+    /* Squared distance from a point to the segment from v to w. The segment
+     * is set up once, so that evaluating it over a row of cells is a short
+     * branch free computation. */
+    class SegmentDistance {
+
+      public:
+
+        SegmentDistance(const bwi_mapper::Point2f& v,
+            const bwi_mapper::Point2f& w) : vx_(v.x), vy_(v.y),
+            dx_(w.x - v.x), dy_(w.y - v.y) {
+          float l2 = dx_ * dx_ + dy_ * dy_;
+          inv_l2_ = (l2 > 0.0f) ? 1.0f / l2 : 0.0f;
+        }
+
+        inline float squared(float x, float y) const {
+          float px = x - vx_;
+          float py = y - vy_;
+          float t = (px * dx_ + py * dy_) * inv_l2_;
+          t = std::min(1.0f, std::max(0.0f, t));
+          float ex = px - t * dx_;
+          float ey = py - t * dy_;
+          return ex * ex + ey * ey;
         }
+
+      private:
+
+        float vx_, vy_, dx_, dy_, inv_l2_;
+
+    };
+
+  } /* namespace */
+
+  bool BaseRobotPositioner::PlacementKey::operator<(
+      const PlacementKey& other) const {
+    if (from_x != other.from_x) return from_x < other.from_x;
+    if (from_y != other.from_y) return from_y < other.from_y;
+    if (at_x != other.at_x) return at_x < other.at_x;
+    if (at_y != other.at_y) return at_y < other.at_y;
+    if (to_x != other.to_x) return to_x < other.to_x;
+    return to_y < other.to_y;
+  }
+
+  geometry_msgs::Pose BaseRobotPositioner::positionRobot(
+      const bwi_mapper::Point2f& from,
+      const bwi_mapper::Point2f& at,
+      const bwi_mapper::Point2f& to) {
+
+    PlacementKey key;
+    key.from_x = from.x; key.from_y = from.y;
+    key.at_x = at.x; key.at_y = at.y;
+    key.to_x = to.x; key.to_y = to.y;
+    {
+      boost::mutex::scoped_lock lock(placement_cache_mutex_);
+      std::map<PlacementKey, geometry_msgs::Pose>::const_iterator it =
+        placement_cache_.find(key);
+      if (it != placement_cache_.end()) {
+        return it->second;
       }
-      ++count;
     }
-    if (!location_verified) {
-      ROS_ERROR_STREAM("Unable to teleport " << entity << " to " << pose
-          << " despite " << attempts << " attempts.");
-      return false;
+
+    bool found;
+    geometry_msgs::Pose resp = searchRobotPosition(from, at, to, found);
+    if (!found) {
+      ROS_WARN_STREAM("No free cell to position a robot near (" << at.x <<
+          ", " << at.y << "), not caching the placement");
+      return resp;
     }
-    return true;
+
+    boost::mutex::scoped_lock lock(placement_cache_mutex_);
+    placement_cache_[key] = resp;
+    return resp;
   }
 
-  geometry_msgs::Pose BaseRobotPositioner::positionRobot(
+  geometry_msgs::Pose BaseRobotPositioner::searchRobotPosition(
       const bwi_mapper::Point2f& from,
       const bwi_mapper::Point2f& at,
-      const bwi_mapper::Point2f& to) {
+      const bwi_mapper::Point2f& to, bool& found) {
 
     geometry_msgs::Pose resp;
     bwi_mapper::Point2f from_map = 
@@ -304,51 +383,63 @@ namespace bwi_guidance {
       use_outside_angle = false;
     }
 
-    size_t y_test = at.y - search_distance_ / map_info_.resolution;
-    float location_fitness = -1;
+    // Search window, clipped to the map. The bounds are computed signed, as
+    // the window extends past the map near its edges.
+    float search_pxl = search_distance_ / map_info_.resolution;
+    int height = map_info_.height;
+    int width = map_info_.width;
+    int y_min = std::min(std::max(0, (int) floorf(at.y - search_pxl)), height);
+    int y_max = std::min(std::max(y_min, (int) ceilf(at.y + search_pxl)),
+        height);
+    int x_min = std::min(std::max(0, (int) floorf(at.x - search_pxl)), width);
+    int x_max = std::min(std::max(x_min, (int) ceilf(at.x + search_pxl)),
+        width);
+    size_t y_begin = y_min, y_end = y_max;
+    size_t x_begin = x_min, x_end = x_max;
+
+    // The fitness of a cell is its distance to the path of the person,
+    // compared in squared form. Cells on the inside of the turn are
+    // rejected with a linear test along the row.
+    SegmentDistance from_at(from, at);
+    SegmentDistance at_to(at, to);
+    bwi_mapper::Point2f outside_normal = from + to - 2 * at;
+    float squared_fitness = -1;
     bwi_mapper::Point2f test_coords;
-    bwi_mapper::Point2f map_coords;
-
-    while(y_test < at.y + search_distance_ / map_info_.resolution) {
-      size_t x_test = at.x - search_distance_ / map_info_.resolution;
-      while (x_test < at.x + search_distance_ / map_info_.resolution) {
-
-        bwi_mapper::Point2f test(x_test, y_test);
-        
-        // Check if x_test, y_test is free.
-        size_t map_idx = MAP_IDX(map_info_.width, x_test, y_test);
-        if (inflated_map_.data[map_idx] != 0) {
-          x_test++;
+    std::vector<float> row_fitness(x_end - x_begin);
+
+    for (size_t y_test = y_begin; y_test < y_end; ++y_test) {
+      for (size_t x_test = x_begin; x_test < x_end; ++x_test) {
+        row_fitness[x_test - x_begin] = 
+          std::min(from_at.squared(x_test, y_test),
+              at_to.squared(x_test, y_test));
+      }
+
+      const int8_t* free_row = 
+        &(inflated_map_.data[MAP_IDX(map_info_.width, 0, y_test)]);
+      float outside_y = outside_normal.y * (y_test - at.y);
+      for (size_t x_test = x_begin; x_test < x_end; ++x_test) {
+        // Check if x_test, y_test is free and on the outside
+        if (free_row[x_test] != 0) {
           continue;
         }
-
-        // Check if it is on the outside or not
-        if (use_outside_angle) {
-          if ((from + to - 2 * at).dot(test - at) > 0) {
-            x_test++;
-            continue;
-          }
+        if (use_outside_angle &&
+            outside_normal.x * (x_test - at.x) + outside_y > 0) {
+          continue;
         }
-
-        bwi_mapper::Point2f test_loc(x_test, y_test);
-
-        float dist1 = 
-          bwi_mapper::minimumDistanceToLineSegment(from, at, test_loc);
-        float dist2 = 
-          bwi_mapper::minimumDistanceToLineSegment(at, to, test_loc);
-        float fitness = std::min(dist1, dist2);
-
-        if (fitness > location_fitness) {
-          test_coords = test_loc;
-          map_coords = bwi_mapper::toMap(test_loc, map_info_);
-          resp.position.x = map_coords.x;
-          resp.position.y = map_coords.y;
-          location_fitness = fitness;
+        float fitness = row_fitness[x_test - x_begin];
+        if (fitness > squared_fitness) {
+          test_coords = bwi_mapper::Point2f(x_test, y_test);
+          squared_fitness = fitness;
         }
-
-        x_test++; 
       }
-      y_test++;
+    }
+
+    found = squared_fitness >= 0;
+    if (found) {
+      bwi_mapper::Point2f map_coords = 
+        bwi_mapper::toMap(test_coords, map_info_);
+      resp.position.x = map_coords.x;
+      resp.position.y = map_coords.y;
     }
 
     // Calculate yaw
@@ -392,26 +483,73 @@ namespace bwi_guidance {
   void BaseRobotPositioner::run() {
     ROS_INFO_STREAM("BaseRobotPositioner starting up...");
     robot_screen_publisher_.start();
-    ros::Rate rate(10);
+
+    // Callbacks are serviced by the spinner, so that this thread can sleep
+    // until a robot changes
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+
     bool first = true;
+    std::vector<std::string> teleport_ids;
+    std::vector<geometry_msgs::Pose> teleport_poses;
+    std::vector<TeleportResult> teleport_results;
     while (ros::ok()) {
       bool change = first;
-      BOOST_FOREACH(const std::string& robot_id, 
-          robot_locations_ | boost::adaptors::map_keys) {
-        bool already_there = checkClosePoses(robot_locations_[robot_id],
-            assigned_robot_locations_[robot_id]);
-        if (!already_there) {
-          change = true;
-          robot_ok_[robot_id] = 
-            teleportEntity(robot_id, robot_locations_[robot_id]);
-          assigned_robot_locations_[robot_id] = robot_locations_[robot_id];
+      teleport_ids.clear();
+      teleport_poses.clear();
+      {
+        boost::mutex::scoped_lock lock(robot_modification_mutex_);
+        while (!first && dirty_robots_.empty() && !status_dirty_) {
+          // The timeout is only used to notice shutdown
+          robots_changed_.timed_wait(lock, 
+              boost::posix_time::milliseconds(500));
+          if (!ros::ok()) {
+            break;
+          }
         }
-        bool orientation_same = 
-          (std::isnan(prev_orientation_[robot_id]) &&
-           std::isnan(robot_screen_orientations_[robot_id])) ||
-          prev_orientation_[robot_id] == robot_screen_orientations_[robot_id];
-        change = change || !orientation_same;
+        BOOST_FOREACH(const std::string& robot_id, dirty_robots_) {
+          if (!checkClosePoses(robot_locations_[robot_id],
+                assigned_robot_locations_[robot_id])) {
+            teleport_ids.push_back(robot_id);
+            teleport_poses.push_back(robot_locations_[robot_id]);
+          }
+          bool orientation_same = 
+            (std::isnan(prev_orientation_[robot_id]) &&
+             std::isnan(robot_screen_orientations_[robot_id])) ||
+            prev_orientation_[robot_id] == robot_screen_orientations_[robot_id];
+          change = change || !orientation_same;
+        }
+        dirty_robots_.clear();
+        change = change || status_dirty_;
+        status_dirty_ = false;
       }
+
+      // Teleport all robots at once, without holding the lock so that
+      // planning does not wait on service calls
+      if (!teleport_ids.empty()) {
+        change = true;
+        if (gazebo_available_) {
+          teleport_scheduler_->teleport(teleport_ids, teleport_poses, 
+              teleport_results);
+        } else {
+          ROS_ERROR_STREAM("Teleportation requested, but gazebo unavailable");
+          TeleportResult failed;
+          failed.success = false;
+          failed.attempts = 0;
+          failed.latency = 0.0f;
+          teleport_results.assign(teleport_ids.size(), failed);
+        }
+        boost::mutex::scoped_lock lock(robot_modification_mutex_);
+        for (size_t i = 0; i < teleport_ids.size(); ++i) {
+          ROS_DEBUG_STREAM("Teleported " << teleport_ids[i] << " in " << 
+              teleport_results[i].latency << "s (" << 
+              teleport_results[i].attempts << " attempts)");
+          robot_ok_[teleport_ids[i]] = teleport_results[i].success;
+          assigned_robot_locations_[teleport_ids[i]] = teleport_poses[i];
+        }
+      }
+
+      boost::mutex::scoped_lock lock(robot_modification_mutex_);
       change = change || (instance_in_progress_ != prev_msg_ready_);
       if (change) {
         bwi_guidance_msgs::RobotInfoArray out_msg;
@@ -432,9 +570,8 @@ namespace bwi_guidance {
         position_publisher_.publish(out_msg);
       }
       first = false;
-      ros::spinOnce();
-      rate.sleep();
     }
+    spinner.stop();
     ROS_INFO_STREAM("BaseRobotPositioner shutting down...");
   }
   
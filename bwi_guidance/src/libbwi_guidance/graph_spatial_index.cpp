@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <bwi_guidance/graph_spatial_index.h>
+
+namespace bwi_guidance {
+
+  namespace {
+
+    struct ClosestVertexQuery {
+      ClosestVertexQuery(const bwi_mapper::Graph& graph,
+          const bwi_mapper::Point2f& point) : graph(graph), point(point),
+          best_distance(std::numeric_limits<float>::max()), best(-1) {}
+      inline void consider(size_t idx) {
+        float distance = bwi_mapper::getMagnitude(graph[idx].location - point);
+        if (distance < best_distance ||
+            (distance == best_distance && idx < best)) {
+          best_distance = distance;
+          best = idx;
+        }
+      }
+      const bwi_mapper::Graph& graph;
+      bwi_mapper::Point2f point;
+      float best_distance;
+      size_t best;
+    };
+
+    template <class Edge>
+    struct ClosestEdgeQuery {
+      ClosestEdgeQuery(const std::vector<Edge>& edges,
+          const bwi_mapper::Point2f& point) : edges(edges), point(point),
+          best_distance(std::numeric_limits<float>::max()), best(-1) {}
+      inline void consider(size_t idx) {
+        float distance = bwi_mapper::minimumDistanceToLineSegment(
+            edges[idx].from, edges[idx].to, point);
+        if (distance < best_distance ||
+            (distance == best_distance && idx < best)) {
+          best_distance = distance;
+          best = idx;
+        }
+      }
+      const std::vector<Edge>& edges;
+      bwi_mapper::Point2f point;
+      float best_distance;
+      size_t best;
+    };
+
+  } /* namespace */
+
+  GraphSpatialIndex::GraphSpatialIndex(const bwi_mapper::Graph& graph,
+      float cell_size) : graph_(graph), cell_size_(cell_size), width_(0),
+      height_(0) {
+
+    // Collect the edges, and the extent of the graph
+    bwi_mapper::Point2f min_pt(std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max());
+    bwi_mapper::Point2f max_pt(-std::numeric_limits<float>::max(),
+        -std::numeric_limits<float>::max());
+    size_t num_vertices = boost::num_vertices(graph_);
+    for (size_t idx = 0; idx < num_vertices; ++idx) {
+      const bwi_mapper::Point2f& location = graph_[idx].location;
+      min_pt.x = std::min(min_pt.x, location.x);
+      min_pt.y = std::min(min_pt.y, location.y);
+      max_pt.x = std::max(max_pt.x, location.x);
+      max_pt.y = std::max(max_pt.y, location.y);
+    }
+    float total_length = 0.0f;
+    bwi_mapper::Graph::edge_iterator ei, eend;
+    for (boost::tie(ei, eend) = boost::edges(graph_); ei != eend; ++ei) {
+      Edge edge;
+      edge.u = boost::source(*ei, graph_);
+      edge.v = boost::target(*ei, graph_);
+      edge.from = graph_[edge.u].location;
+      edge.to = graph_[edge.v].location;
+      total_length += bwi_mapper::getMagnitude(edge.to - edge.from);
+      edges_.push_back(edge);
+    }
+    if (num_vertices == 0) {
+      return;
+    }
+
+    if (cell_size_ <= 0.0f) {
+      cell_size_ = (edges_.empty()) ? 1.0f : total_length / edges_.size();
+    }
+    cell_size_ = std::max(cell_size_, 1.0f);
+    origin_ = min_pt;
+    width_ = (int)((max_pt.x - min_pt.x) / cell_size_) + 1;
+    height_ = (int)((max_pt.y - min_pt.y) / cell_size_) + 1;
+    vertex_cells_.resize(width_ * height_);
+    edge_cells_.resize(width_ * height_);
+
+    for (size_t idx = 0; idx < num_vertices; ++idx) {
+      int x, y;
+      getCell(graph_[idx].location, x, y);
+      vertex_cells_[getCellIdx(x, y)].push_back(idx);
+    }
+
+    // Every edge is added to all the cells overlapping its bounding box
+    for (size_t e = 0; e < edges_.size(); ++e) {
+      int x1, y1, x2, y2;
+      getCell(edges_[e].from, x1, y1);
+      getCell(edges_[e].to, x2, y2);
+      for (int y = std::min(y1, y2); y <= std::max(y1, y2); ++y) {
+        for (int x = std::min(x1, x2); x <= std::max(x1, x2); ++x) {
+          edge_cells_[getCellIdx(x, y)].push_back(e);
+        }
+      }
+    }
+  }
+
+  size_t GraphSpatialIndex::getClosestVertex(
+      const bwi_mapper::Point2f& point, float threshold) const {
+    ClosestVertexQuery query(graph_, point);
+    searchRings(point, vertex_cells_, query);
+    if (threshold != 0.0f && query.best_distance > threshold) {
+      return -1;
+    }
+    return query.best;
+  }
+
+  bool GraphSpatialIndex::getClosestEdge(const bwi_mapper::Point2f& point,
+      size_t& u, size_t& v, float& distance) const {
+    ClosestEdgeQuery<Edge> query(edges_, point);
+    searchRings(point, edge_cells_, query);
+    if (query.best == (size_t)-1) {
+      return false;
+    }
+    u = edges_[query.best].u;
+    v = edges_[query.best].v;
+    distance = query.best_distance;
+    return true;
+  }
+
+  size_t GraphSpatialIndex::getClosestIdOnEdgeToward(
+      const bwi_mapper::Point2f& point,
+      const bwi_mapper::Point2f& toward) const {
+    size_t u, v;
+    float distance;
+    if (!getClosestEdge(point, u, v, distance)) {
+      return -1;
+    }
+    if (bwi_mapper::getMagnitude(graph_[u].location - toward) <
+        bwi_mapper::getMagnitude(graph_[v].location - toward)) {
+      return u;
+    }
+    return v;
+  }
+
+  void GraphSpatialIndex::getCell(const bwi_mapper::Point2f& point,
+      int& x, int& y) const {
+    x = (int)floorf((point.x - origin_.x) / cell_size_);
+    y = (int)floorf((point.y - origin_.y) / cell_size_);
+  }
+
+  template <class Query>
+  void GraphSpatialIndex::searchRings(const bwi_mapper::Point2f& point,
+      const std::vector<std::vector<size_t> >& cells, Query& query) const {
+
+    if (cells.empty()) {
+      return;
+    }
+
+    // The query point may lie outside the grid
+    int cx, cy;
+    getCell(point, cx, cy);
+    int max_radius = std::max(std::max(std::abs(cx), std::abs(cx - width_ + 1)),
+        std::max(std::abs(cy), std::abs(cy - height_ + 1)));
+
+    for (int r = 0; r <= max_radius; ++r) {
+      // Everything in ring r is at least (r - 1) cells away from point
+      if (r > 0 && query.best_distance <= (r - 1) * cell_size_) {
+        break;
+      }
+      int y_min = std::max(cy - r, 0);
+      int y_max = std::min(cy + r, height_ - 1);
+      for (int y = y_min; y <= y_max; ++y) {
+        // Only the first and last column of the ring, except on its first
+        // and last row
+        bool full_row = (y == cy - r || y == cy + r);
+        int x_step = (full_row || r == 0) ? 1 : 2 * r;
+        for (int x = cx - r; x <= cx + r; x += x_step) {
+          if (x < 0 || x >= width_) {
+            continue;
+          }
+          const std::vector<size_t>& cell = cells[getCellIdx(x, y)];
+          for (size_t i = 0; i < cell.size(); ++i) {
+            query.consider(cell[i]);
+          }
+        }
+      }
+    }
+  }
+
+} /* bwi_guidance */
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <bwi_guidance/graph_tracker.h>
+
+namespace bwi_guidance {
+
+  /* Bounds the work done for a single observation */
+  const unsigned int MAX_TRANSITIONS_PER_UPDATE = 16;
+
+  GraphTracker::GraphTracker(const GraphSpatialIndex& graph_index,
+      float hysteresis, float relocalize_distance) : 
+      graph_index_(graph_index), relocalize_distance_(relocalize_distance),
+      current_vertex_(0), next_vertex_(0), precision_(0.0f), 
+      distance_(0.0f) {
+
+    const bwi_mapper::Graph& graph = graph_index_.getGraph();
+    edges_.resize(boost::num_vertices(graph));
+    bwi_mapper::Graph::edge_iterator ei, eend;
+    for (boost::tie(ei, eend) = boost::edges(graph); ei != eend; ++ei) {
+      size_t u = boost::source(*ei, graph);
+      size_t v = boost::target(*ei, graph);
+      for (int reverse = 0; reverse < 2; ++reverse) {
+        Edge edge;
+        size_t from = (reverse) ? v : u;
+        edge.to = (reverse) ? u : v;
+        edge.from_loc = graph[from].location;
+        edge.direction = graph[edge.to].location - edge.from_loc;
+        edge.squared_length = edge.direction.dot(edge.direction);
+        float length = sqrtf(edge.squared_length);
+        edge.transition_precision = 0.5f + ((length == 0.0f) ? 0.0f :
+            std::min(hysteresis / length, 0.25f));
+        edges_[from].push_back(edge);
+      }
+    }
+  }
+
+  void GraphTracker::reset(size_t vertex) {
+    current_vertex_ = vertex;
+    next_vertex_ = vertex;
+    precision_ = 0.0f;
+    distance_ = 0.0f;
+  }
+
+  bool GraphTracker::update(const bwi_mapper::Point2f& point,
+      std::vector<size_t>& transitions) {
+
+    size_t start_vertex = current_vertex_;
+    for (unsigned int i = 0; i < MAX_TRANSITIONS_PER_UPDATE; ++i) {
+      const Edge* edge;
+      float precision, squared_distance;
+      if (!findClosestEdge(point, edge, precision, squared_distance)) {
+        break;
+      }
+      if (relocalize_distance_ != 0.0f && 
+          squared_distance > relocalize_distance_ * relocalize_distance_) {
+        relocalize(point, transitions);
+        break;
+      }
+
+      next_vertex_ = edge->to;
+      precision_ = precision;
+      distance_ = sqrtf(squared_distance);
+      if (precision <= edge->transition_precision) {
+        break;
+      }
+
+      // Continue from the other end of the edge, which might be past the 
+      // middle of one of its own edges as well
+      next_vertex_ = current_vertex_;
+      current_vertex_ = edge->to;
+      precision_ = 1.0f - precision;
+      transitions.push_back(current_vertex_);
+    }
+    return current_vertex_ != start_vertex;
+  }
+
+  float GraphTracker::project(const Edge& edge, 
+      const bwi_mapper::Point2f& point, float& precision) const {
+    bwi_mapper::Point2f offset = point - edge.from_loc;
+    precision = (edge.squared_length == 0.0f) ? 0.0f :
+      offset.dot(edge.direction) / edge.squared_length;
+    precision = std::max(0.0f, std::min(1.0f, precision));
+    bwi_mapper::Point2f projection_offset = offset - precision * edge.direction;
+    return projection_offset.dot(projection_offset);
+  }
+
+  bool GraphTracker::findClosestEdge(const bwi_mapper::Point2f& point, 
+      const Edge*& closest_edge, float& precision, 
+      float& squared_distance) const {
+    const std::vector<Edge>& edges = edges_[current_vertex_];
+    squared_distance = std::numeric_limits<float>::max();
+    for (size_t e = 0; e < edges.size(); ++e) {
+      float edge_precision;
+      float edge_squared_distance = project(edges[e], point, edge_precision);
+      if (edge_squared_distance < squared_distance) {
+        squared_distance = edge_squared_distance;
+        precision = edge_precision;
+        closest_edge = &edges[e];
+      }
+    }
+    return !edges.empty();
+  }
+
+  void GraphTracker::relocalize(const bwi_mapper::Point2f& point,
+      std::vector<size_t>& transitions) {
+    size_t u, v;
+    float distance;
+    if (!graph_index_.getClosestEdge(point, u, v, distance)) {
+      return;
+    }
+    const std::vector<Edge>& edges = edges_[u];
+    for (size_t e = 0; e < edges.size(); ++e) {
+      if (edges[e].to == v) {
+        float precision;
+        project(edges[e], point, precision);
+        size_t previous_vertex = current_vertex_;
+        if (precision > 0.5f) {
+          current_vertex_ = v;
+          next_vertex_ = u;
+          precision_ = 1.0f - precision;
+        } else {
+          current_vertex_ = u;
+          next_vertex_ = v;
+          precision_ = precision;
+        }
+        distance_ = distance;
+        if (current_vertex_ != previous_vertex) {
+          transitions.push_back(current_vertex_);
+        }
+        return;
+      }
+    }
+  }
+
+} /* bwi_guidance */
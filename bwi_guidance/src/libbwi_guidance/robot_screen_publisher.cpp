@@ -1,13 +1,15 @@
 #include <bwi_guidance/robot_screen_publisher.h>
-#include <boost/range/adaptor/map.hpp>
 #include <boost/foreach.hpp>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/image_encodings.h>
+#include <utility>
+#include <vector>
 
 namespace bwi_guidance {
 
   RobotScreenPublisher::RobotScreenPublisher(
-      boost::shared_ptr<ros::NodeHandle>& nh) : nh_(nh) {}
+      boost::shared_ptr<ros::NodeHandle>& nh, float keepalive_period) : 
+    nh_(nh), keepalive_period_(keepalive_period) {}
 
   RobotScreenPublisher::~RobotScreenPublisher() {
     if (publishing_thread_) {
@@ -17,20 +19,46 @@ namespace bwi_guidance {
   }
 
   void RobotScreenPublisher::addRobot(const std::string& robot_id) {
-    if (robot_image_publisher_.find(robot_id) != robot_image_publisher_.end()) {
+    boost::mutex::scoped_lock lock(robot_screens_mutex_);
+    if (robot_screens_.find(robot_id) != robot_screens_.end()) {
       ROS_ERROR_STREAM("RobotScreenPublisher: Id " << robot_id << " exists!");
       return;
     }
-    robot_image_publisher_[robot_id] = 
+    RobotScreen& screen = robot_screens_[robot_id];
+    screen.publisher = 
       nh_->advertise<sensor_msgs::Image>(robot_id + "/image", 1);
-    robot_image_[robot_id] = cv::Mat::zeros(120, 160, CV_8UC3);
-    robot_image_lock_[robot_id].reset(new boost::mutex);
+    setImage(robot_id, screen, cv::Mat::zeros(120, 160, CV_8UC3));
   }
 
   void RobotScreenPublisher::updateImage(const std::string& robot_id, 
       const cv::Mat& mat) {
-    boost::mutex::scoped_lock lock(*(robot_image_lock_[robot_id]));
-    robot_image_[robot_id] = mat;
+    boost::mutex::scoped_lock lock(robot_screens_mutex_);
+    std::map<std::string, RobotScreen>::iterator it = 
+      robot_screens_.find(robot_id);
+    if (it == robot_screens_.end()) {
+      ROS_ERROR_STREAM("RobotScreenPublisher: Id " << robot_id << 
+          " does not exist!");
+      return;
+    }
+    RobotScreen& screen = it->second;
+    if (mat.data == screen.image.data && mat.rows == screen.image.rows &&
+        mat.cols == screen.image.cols && mat.type() == screen.image.type()) {
+      return;
+    }
+    setImage(robot_id, screen, mat);
+    screen_changed_.notify_one();
+  }
+
+  void RobotScreenPublisher::setImage(const std::string& robot_id,
+      RobotScreen& screen, const cv::Mat& image) {
+    cv_bridge::CvImage out_image;
+    out_image.header.frame_id = robot_id + "/laptop_screen_link";
+    out_image.header.stamp = ros::Time::now();
+    out_image.encoding = sensor_msgs::image_encodings::BGR8;
+    out_image.image = image;
+    screen.image = image;
+    screen.message = out_image.toImageMsg();
+    screen.changed = true;
   }
 
   void RobotScreenPublisher::start() {
@@ -40,19 +68,39 @@ namespace bwi_guidance {
   }
 
   void RobotScreenPublisher::run() {
-    ros::Rate rate(5);
+    typedef std::pair<ros::Publisher, sensor_msgs::ImageConstPtr> Output;
+    std::vector<Output> outputs;
+    boost::posix_time::time_duration keepalive = 
+      boost::posix_time::microseconds((long)(1e6 * keepalive_period_));
+    boost::system_time next_keepalive = boost::get_system_time();
     while (ros::ok()) {
-      BOOST_FOREACH(const std::string& robot_id, 
-          robot_image_publisher_ | boost::adaptors::map_keys) {
-        boost::mutex::scoped_lock lock(*(robot_image_lock_[robot_id]));
-        cv_bridge::CvImage out_image;
-        out_image.header.frame_id = robot_id + "/laptop_screen_link";
-        out_image.header.stamp = ros::Time::now();
-        out_image.encoding = sensor_msgs::image_encodings::BGR8;
-        out_image.image = robot_image_[robot_id];
-        robot_image_publisher_[robot_id].publish(out_image.toImageMsg());
+      outputs.clear();
+      {
+        boost::mutex::scoped_lock lock(robot_screens_mutex_);
+        bool publish_all = boost::get_system_time() >= next_keepalive;
+        if (publish_all) {
+          next_keepalive = boost::get_system_time() + keepalive;
+        }
+        for (std::map<std::string, RobotScreen>::iterator it = 
+            robot_screens_.begin(); it != robot_screens_.end(); ++it) {
+          RobotScreen& screen = it->second;
+          if (publish_all || screen.changed) {
+            outputs.push_back(Output(screen.publisher, screen.message));
+            screen.changed = false;
+          }
+        }
+        if (outputs.empty()) {
+          // The timeout is also used to notice shutdown
+          screen_changed_.timed_wait(lock, next_keepalive);
+          continue;
+        }
+      }
+
+      // Messages are never modified once created, so they can be published
+      // without the lock
+      BOOST_FOREACH(const Output& output, outputs) {
+        output.first.publish(output.second);
       }
-      rate.sleep();
     }
   }
   
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <cmath>
+#include <gazebo_msgs/GetModelState.h>
+#include <gazebo_msgs/SetModelState.h>
+#include <tf/transform_datatypes.h>
+
+#include <bwi_guidance/teleport_scheduler.h>
+
+namespace bwi_guidance {
+
+  bool checkClosePoses(const geometry_msgs::Pose& p1,
+      const geometry_msgs::Pose& p2) {
+    if (fabs(p1.position.x - p2.position.x) > 0.05 ||
+        fabs(p1.position.y - p2.position.y) > 0.05) {
+      return false;
+    }
+    double yaw1 = tf::getYaw(p1.orientation);
+    double yaw2 = tf::getYaw(p2.orientation);
+    if (fabs(yaw1 - yaw2) > 0.1) {
+      return false;
+    }
+    return true;
+  }
+
+  GazeboModelStateService::GazeboModelStateService(
+      boost::shared_ptr<ros::NodeHandle>& nh) : nh_(nh) {}
+
+  bool GazeboModelStateService::getModelPose(const std::string& entity,
+      geometry_msgs::Pose& pose) {
+    ros::ServiceClient client = nh_->serviceClient<gazebo_msgs::GetModelState>(
+        "gazebo/get_model_state");
+    gazebo_msgs::GetModelState get_srv;
+    get_srv.request.model_name = entity;
+    if (!client.call(get_srv)) {
+      return false;
+    }
+    pose = get_srv.response.pose;
+    return true;
+  }
+
+  bool GazeboModelStateService::setModelPose(const std::string& entity,
+      const geometry_msgs::Pose& pose) {
+    ros::ServiceClient client = nh_->serviceClient<gazebo_msgs::SetModelState>(
+        "gazebo/set_model_state");
+    gazebo_msgs::SetModelState set_srv;
+    set_srv.request.model_state.model_name = entity;
+    set_srv.request.model_state.pose = pose;
+    return client.call(set_srv) && set_srv.response.success;
+  }
+
+  TeleportScheduler::TeleportScheduler(
+      const boost::shared_ptr<ModelStateService>& service,
+      unsigned int num_workers, unsigned int attempts) : service_(service),
+      attempts_(attempts), entities_(NULL), poses_(NULL), results_(NULL),
+      jobs_remaining_(0), stop_(false) {
+    for (unsigned int i = 0; i < std::max(num_workers, 1u); ++i) {
+      workers_.create_thread(boost::bind(&TeleportScheduler::runWorker, this));
+    }
+  }
+
+  TeleportScheduler::~TeleportScheduler() {
+    {
+      boost::mutex::scoped_lock lock(batch_mutex_);
+      stop_ = true;
+      job_available_.notify_all();
+    }
+    workers_.join_all();
+  }
+
+  void TeleportScheduler::teleport(const std::vector<std::string>& entities,
+      const std::vector<geometry_msgs::Pose>& poses,
+      std::vector<TeleportResult>& results) {
+    results.resize(entities.size());
+    boost::mutex::scoped_lock lock(batch_mutex_);
+    entities_ = &entities;
+    poses_ = &poses;
+    results_ = &results;
+    batch_start_ = boost::posix_time::microsec_clock::universal_time();
+    for (size_t i = 0; i < entities.size(); ++i) {
+      jobs_.push_back(i);
+    }
+    jobs_remaining_ = entities.size();
+    job_available_.notify_all();
+    while (jobs_remaining_ != 0) {
+      batch_done_.wait(lock);
+    }
+    entities_ = NULL;
+    poses_ = NULL;
+    results_ = NULL;
+  }
+
+  void TeleportScheduler::runWorker() {
+    while (true) {
+      size_t job;
+      std::string entity;
+      geometry_msgs::Pose pose;
+      boost::posix_time::ptime batch_start;
+      {
+        boost::mutex::scoped_lock lock(batch_mutex_);
+        while (!stop_ && jobs_.empty()) {
+          job_available_.wait(lock);
+        }
+        if (stop_) {
+          return;
+        }
+        job = jobs_.front();
+        jobs_.pop_front();
+        entity = (*entities_)[job];
+        pose = (*poses_)[job];
+        batch_start = batch_start_;
+      }
+
+      TeleportResult result = teleportEntity(entity, pose, batch_start);
+
+      boost::mutex::scoped_lock lock(batch_mutex_);
+      (*results_)[job] = result;
+      --jobs_remaining_;
+      if (jobs_remaining_ == 0) {
+        batch_done_.notify_all();
+      }
+    }
+  }
+
+  TeleportResult TeleportScheduler::teleportEntity(const std::string& entity,
+      const geometry_msgs::Pose& pose, 
+      const boost::posix_time::ptime& batch_start) {
+
+    // Entities are only scheduled when they need to move, so the pose is 
+    // set before it is first verified
+    TeleportResult result;
+    result.success = false;
+    result.attempts = 0;
+    while (result.attempts < attempts_ && !result.success) {
+      if (!service_->setModelPose(entity, pose)) {
+        ROS_WARN_STREAM("SetModelState service call failed for " << entity
+            << " to " << pose);
+      }
+      geometry_msgs::Pose current_pose;
+      result.success = service_->getModelPose(entity, current_pose) &&
+        checkClosePoses(current_pose, pose);
+      ++result.attempts;
+    }
+    result.latency = 
+      (boost::posix_time::microsec_clock::universal_time() - batch_start)
+      .total_microseconds() / 1e6f;
+    if (!result.success) {
+      ROS_ERROR_STREAM("Unable to teleport " << entity << " to " << pose
+          << " despite " << attempts_ << " attempts.");
+    }
+    return result;
+  }
+
+} /* bwi_guidance */
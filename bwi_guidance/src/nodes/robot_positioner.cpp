@@ -156,7 +156,7 @@ class DataCollectionRobotPositioner : public bwi_guidance::BaseRobotPositioner {
 
         // Teleport the robot and assign a direction
         std::string robot_id = default_robots_.robots[assigned_robots_].id;
-        robot_locations_[robot_id] = pose;
+        setRobotLocation(robot_id, pose);
         robot_images_.push_back(robot_image);
         robot_orientations_.push_back(destination_yaw);
         ++assigned_robots_;
@@ -165,8 +165,8 @@ class DataCollectionRobotPositioner : public bwi_guidance::BaseRobotPositioner {
       // Assign robots not controlled by the path
       BOOST_FOREACH(const Location& location, robots_in_instance.robots) {
         std::string robot_id = default_robots_.robots[assigned_robots_].id;
-        robot_locations_[robot_id] = 
-          convert2dToPose(location.x, location.y, location.yaw);
+        setRobotLocation(robot_id, 
+            convert2dToPose(location.x, location.y, location.yaw));
         robot_images_.push_back(blank_image_);
         robot_orientations_.push_back(std::numeric_limits<float>::quiet_NaN());
         ++assigned_robots_;
@@ -192,11 +192,11 @@ class DataCollectionRobotPositioner : public bwi_guidance::BaseRobotPositioner {
             bwi_mapper::getMagnitude(robot_loc - person_loc);
           if (distance < 3.0) {
             robot_screen_publisher_.updateImage(robot.id, robot_images_[count]);
-            robot_screen_orientations_[robot.id] = robot_orientations_[count];
+            setRobotScreenOrientation(robot.id, robot_orientations_[count]);
           } else {
             robot_screen_publisher_.updateImage(robot.id, blank_image_);
-            robot_screen_orientations_[robot.id] = 
-                std::numeric_limits<float>::quiet_NaN(); 
+            setRobotScreenOrientation(robot.id, 
+                std::numeric_limits<float>::quiet_NaN()); 
           }
         }
         ++count;
@@ -0,0 +1,78 @@
+#include <bwi_guidance/teleport_scheduler.h>
+#include <tf/transform_datatypes.h>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace bwi_guidance;
+
+/* Stand-in for gazebo, where every service call takes a round trip */
+class MockModelStateService : public ModelStateService {
+  public:
+    MockModelStateService(int round_trip_ms) : round_trip_ms_(round_trip_ms) {}
+    virtual bool getModelPose(const std::string& entity, 
+        geometry_msgs::Pose& pose) {
+      boost::this_thread::sleep(
+          boost::posix_time::milliseconds(round_trip_ms_));
+      boost::mutex::scoped_lock lock(mutex_);
+      pose = poses_[entity];
+      return true;
+    }
+    virtual bool setModelPose(const std::string& entity,
+        const geometry_msgs::Pose& pose) {
+      boost::this_thread::sleep(
+          boost::posix_time::milliseconds(round_trip_ms_));
+      boost::mutex::scoped_lock lock(mutex_);
+      poses_[entity] = pose;
+      return true;
+    }
+  private:
+    int round_trip_ms_;
+    boost::mutex mutex_;
+    std::map<std::string, geometry_msgs::Pose> poses_;
+};
+
+int main(int argc, char *argv[]) {
+
+  int num_robots = (argc > 1) ? atoi(argv[1]) : 10;
+  int round_trip_ms = (argc > 2) ? atoi(argv[2]) : 20;
+
+  boost::shared_ptr<ModelStateService> service(
+      new MockModelStateService(round_trip_ms));
+  TeleportScheduler scheduler(service, num_robots);
+
+  std::vector<std::string> entities;
+  std::vector<geometry_msgs::Pose> poses;
+  for (int i = 0; i < num_robots; ++i) {
+    std::stringstream ss;
+    ss << "robot" << i;
+    entities.push_back(ss.str());
+    geometry_msgs::Pose pose;
+    pose.position.x = i;
+    pose.position.y = 2 * i;
+    pose.orientation = tf::createQuaternionMsgFromYaw(0.1 * i);
+    poses.push_back(pose);
+  }
+
+  std::vector<TeleportResult> results;
+  boost::posix_time::ptime start = 
+    boost::posix_time::microsec_clock::universal_time();
+  scheduler.teleport(entities, poses, results);
+  boost::posix_time::time_duration duration = 
+    boost::posix_time::microsec_clock::universal_time() - start;
+
+  bool success = true;
+  for (size_t i = 0; i < entities.size(); ++i) {
+    std::cout << entities[i] << ": " << 
+      ((results[i].success) ? "ok" : "FAILED") << " in " << 
+      results[i].latency << "s (" << results[i].attempts << " attempts)" << 
+      std::endl;
+    success = success && results[i].success;
+  }
+  std::cout << "Batch of " << num_robots << " robots took " << 
+    duration.total_milliseconds() << "ms, with a round trip of " << 
+    round_trip_ms << "ms" << std::endl;
+
+  return (success) ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#ifndef BWI_GUIDANCE_SOLVER_ANGLE_TABLES
+#define BWI_GUIDANCE_SOLVER_ANGLE_TABLES
+
+#include <vector>
+
+#include <bwi_guidance_solver/common.h>
+#include <bwi_mapper/graph.h>
+
+namespace bwi_guidance {
+
+  /* Precomputed angles between the vertices of a graph. For every pair of
+   * vertices (u, v), stores bwi_mapper::getNodeAngle(u, v) and its
+   * discretized direction, so that the person models do not need to call
+   * atan2 and normalize angles while computing transitions. The table is
+   * read only once constructed, and can be shared between threads. */
+  class GraphAngleTable {
+
+    public:
+
+      GraphAngleTable() : num_vertices_(0) {}
+      explicit GraphAngleTable(const bwi_mapper::Graph& graph);
+
+      inline unsigned int getNumVertices() const { return num_vertices_; }
+
+      /* Same as bwi_mapper::getNodeAngle(u, v, graph) */
+      inline float getNodeAngle(int u, int v) const {
+        return node_angle_[u * num_vertices_ + v];
+      }
+      /* Same as computeNextDirection(dir, u, v, graph) */
+      inline int getDirection(int u, int v) const {
+        return direction_[u * num_vertices_ + v];
+      }
+      /* Same as getAngleInRadians(dir) for 0 <= dir < NUM_DIRECTIONS */
+      inline float getDirectionAngle(int dir) const {
+        return direction_angle_[dir];
+      }
+
+      /* Adjacent vertices of u, in the order of bwi_mapper::getAdjacentNodes
+       * (and computeAdjacentVertices) */
+      inline const std::vector<int>& getAdjacentVertices(int u) const {
+        return adjacent_vertices_[u];
+      }
+      /* Position of v in getAdjacentVertices(u), or -1 if not adjacent */
+      inline int getAdjacentPosition(int u, int v) const {
+        return adjacent_position_[u * num_vertices_ + v];
+      }
+
+    private:
+
+      unsigned int num_vertices_;
+      std::vector<float> node_angle_; // num_vertices * num_vertices
+      std::vector<int> direction_; // num_vertices * num_vertices
+      std::vector<float> direction_angle_; // NUM_DIRECTIONS
+      std::vector<std::vector<int> > adjacent_vertices_;
+      std::vector<int> adjacent_position_; // num_vertices * num_vertices
+
+  };
+
+  /* Variance (in radians^2) of the human motion model, and of the IROS14
+   * motion model right after a robot has given the person a direction */
+  const double MOTION_SIGMA_SQ = 0.1;
+  const double DIRECTED_MOTION_SIGMA_SQ = 0.05;
+
+  /* Unnormalized weight of the human motion model for moving at angle, when
+   * the person is expected to move at angle expected_dir, i.e.
+   *   exp(-getAbsoluteAngleDifference(angle, expected_dir)^2 / (2 * sigma_sq))
+   * computed in double precision. */
+  double getMotionWeight(float angle, float expected_dir, double sigma_sq);
+
+  /* getMotionWeight() from every vertex to each of its adjacent vertices,
+   * for every expected direction of the person. The expected direction is
+   * either one of the NUM_DIRECTIONS discretized directions, or the
+   * direction to an adjacent vertex (a robot pointing that way). */
+  class MotionWeightTable {
+
+    public:
+
+      MotionWeightTable() {}
+      MotionWeightTable(const GraphAngleTable& angles, double sigma_sq);
+
+      /* Weight of moving from u to its i-th adjacent vertex, when the person
+       * is expected to move in direction dir */
+      inline double getWeightToDirection(int u, int i, int dir) const {
+        return weights_[offset_[u] + i * row_size_[u] + dir];
+      }
+      /* Weight of moving from u to its i-th adjacent vertex, when the person
+       * is expected to move towards its j-th adjacent vertex */
+      inline double getWeightToAdjacent(int u, int i, int j) const {
+        return weights_[offset_[u] + i * row_size_[u] + NUM_DIRECTIONS + j];
+      }
+
+    private:
+
+      std::vector<unsigned int> offset_;
+      std::vector<unsigned int> row_size_;
+      std::vector<double> weights_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_ANGLE_TABLES */
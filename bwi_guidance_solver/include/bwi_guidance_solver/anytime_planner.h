@@ -0,0 +1,194 @@
+#ifndef BWI_GUIDANCE_SOLVER_ANYTIME_PLANNER
+#define BWI_GUIDANCE_SOLVER_ANYTIME_PLANNER
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <bwi_guidance_solver/search_planner.h>
+
+namespace bwi_guidance {
+
+  /* What happens to the search tree when a new state is observed. Ordered
+   * by strength, so that pending updates can be combined with std::max. */
+  enum SearchTreeUpdate {
+    KEEP_SEARCH_TREE = 0,
+    REROOT_SEARCH_TREE = 1,
+    RESTART_SEARCH_TREE = 2
+  };
+
+  /* Anytime front-end for a SearchPlanner. A background thread repeatedly
+   * searches from the most recently observed state in slices (one call to
+   * SearchPlanner::search() each, so the slice length is the planning time
+   * of the planner's params), and keeps the best action found after every
+   * slice. getAction() returns that action at an absolute deadline without
+   * waiting for the slice in progress, so decision latency does not depend
+   * on the speed of the machine or the length of a slice. The wrapped
+   * planner must not be used directly while the background thread runs. */
+  template <class State, class Action>
+  class AnytimePlanner {
+
+    public:
+
+      AnytimePlanner(
+          const boost::shared_ptr<SearchPlanner<State, Action> >& planner) :
+        planner_(planner), stop_(false), has_state_(false),
+        pending_update_(KEEP_SEARCH_TREE), state_version_(0),
+        has_action_(false), playouts_(0), terminations_(0), slices_(0) {}
+
+      virtual ~AnytimePlanner() {
+        stop();
+      }
+
+      /* Starts the background search. It idles until a state is set. */
+      void start() {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (planning_thread_) {
+          return;
+        }
+        stop_ = false;
+        planning_thread_.reset(
+            new boost::thread(boost::bind(&AnytimePlanner::run, this)));
+      }
+
+      /* Stops the background search after the slice in progress. The
+       * wrapped planner can be used directly again once this returns. */
+      void stop() {
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          if (!planning_thread_) {
+            return;
+          }
+          stop_ = true;
+          state_changed_.notify_all();
+        }
+        planning_thread_->join();
+        boost::mutex::scoped_lock lock(mutex_);
+        planning_thread_.reset();
+      }
+
+      /* Searches from state from now on. The update is applied to the search
+       * tree by the background thread before its next slice, and no action
+       * is available for state until that slice completes. */
+      void setState(const State& state, SearchTreeUpdate update) {
+        boost::mutex::scoped_lock lock(mutex_);
+        state_ = state;
+        has_state_ = true;
+        pending_update_ = std::max(pending_update_, update);
+        ++state_version_;
+        has_action_ = false;
+        state_changed_.notify_all();
+      }
+
+      /* Waits until deadline (in boost::get_system_time() terms) and returns
+       * the best action found so far for the current state. Returns false if
+       * no search slice for the current state completed before the deadline.
+       * Rethrows any error raised by the background search. */
+      bool getAction(const boost::system_time& deadline, Action& action) {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (error_.empty() && boost::get_system_time() < deadline) {
+          action_found_.timed_wait(lock, deadline);
+        }
+        if (!error_.empty()) {
+          throw std::runtime_error(error_);
+        }
+        if (!has_action_) {
+          return false;
+        }
+        action = action_;
+        return true;
+      }
+
+      /* Totals over all completed slices since construction */
+      unsigned int getNumPlayouts() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return playouts_;
+      }
+      unsigned int getNumTerminations() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return terminations_;
+      }
+      unsigned int getNumSlices() const {
+        boost::mutex::scoped_lock lock(mutex_);
+        return slices_;
+      }
+
+    private:
+
+      void run() {
+        try {
+          while (true) {
+            State state;
+            SearchTreeUpdate update;
+            unsigned int state_version;
+            {
+              boost::mutex::scoped_lock lock(mutex_);
+              while (!stop_ && !has_state_) {
+                state_changed_.wait(lock);
+              }
+              if (stop_) {
+                return;
+              }
+              state = state_;
+              state_version = state_version_;
+              update = pending_update_;
+              pending_update_ = KEEP_SEARCH_TREE;
+            }
+
+            if (update == REROOT_SEARCH_TREE) {
+              planner_->reroot(state);
+            } else if (update == RESTART_SEARCH_TREE) {
+              planner_->restart();
+            }
+            unsigned int terminations;
+            unsigned int playouts = planner_->search(state, terminations);
+            Action action = planner_->selectWorldAction(state);
+
+            boost::mutex::scoped_lock lock(mutex_);
+            playouts_ += playouts;
+            terminations_ += terminations;
+            ++slices_;
+            // Discard the action if the state changed during the slice
+            if (state_version == state_version_) {
+              action_ = action;
+              has_action_ = true;
+              action_found_.notify_all();
+            }
+          }
+        } catch (const std::exception& e) {
+          boost::mutex::scoped_lock lock(mutex_);
+          error_ = e.what();
+          action_found_.notify_all();
+        }
+      }
+
+      boost::shared_ptr<SearchPlanner<State, Action> > planner_;
+      boost::shared_ptr<boost::thread> planning_thread_;
+
+      mutable boost::mutex mutex_;
+      boost::condition_variable state_changed_;
+      boost::condition_variable action_found_;
+      bool stop_;
+
+      State state_;
+      bool has_state_;
+      SearchTreeUpdate pending_update_;
+      unsigned int state_version_;
+
+      Action action_;
+      bool has_action_;
+      std::string error_;
+
+      unsigned int playouts_;
+      unsigned int terminations_;
+      unsigned int slices_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_ANYTIME_PLANNER */
@@ -0,0 +1,121 @@
+#ifndef BWI_GUIDANCE_SOLVER_ARENA
+#define BWI_GUIDANCE_SOLVER_ARENA
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace bwi_guidance {
+
+  /* Bump allocator. Memory is handed out from large blocks, and is only
+   * released all at once by reset(), which keeps the blocks around for
+   * reuse. Objects placed in an arena are never destroyed, so they need to
+   * be trivially destructible. Not thread safe. */
+  class Arena {
+
+    public:
+
+      explicit Arena(std::size_t block_size = 1 << 20);
+      ~Arena();
+
+      /* size bytes, aligned to ALIGNMENT */
+      void* allocate(std::size_t size);
+
+      /* Releases everything allocated so far, in constant time */
+      void reset();
+
+      /* Exchanges the blocks of both arenas */
+      void swap(Arena& other);
+
+      inline std::size_t getBytesAllocated() const { return bytes_allocated_; }
+      std::size_t getCapacity() const;
+
+      static const std::size_t ALIGNMENT = 16;
+
+    private:
+
+      /* Not copyable */
+      Arena(const Arena&);
+      Arena& operator=(const Arena&);
+
+      std::size_t block_size_;
+      std::vector<char*> blocks_;
+      std::vector<std::size_t> block_sizes_;
+      std::size_t current_block_;
+      std::size_t offset_;
+      std::size_t bytes_allocated_;
+
+  };
+
+  /* Fixed size array of trivially copyable elements stored in an Arena. Does
+   * not own its elements, so copying it is shallow. */
+  template <typename T>
+  class ArenaArray {
+
+    public:
+
+      ArenaArray() : data_(NULL), size_(0) {}
+
+      /* Copies size elements from values into arena */
+      void assign(Arena& arena, const T* values, unsigned int size) {
+        data_ = static_cast<T*>(arena.allocate(size * sizeof(T)));
+        for (unsigned int i = 0; i < size; ++i) {
+          new (data_ + i) T(values[i]);
+        }
+        size_ = size;
+      }
+
+      inline unsigned int size() const { return size_; }
+      inline T& operator[](unsigned int i) { return data_[i]; }
+      inline const T& operator[](unsigned int i) const { return data_[i]; }
+      inline const T* data() const { return data_; }
+
+    private:
+
+      T* data_;
+      unsigned int size_;
+
+  };
+
+  /* Singly linked list of trivially copyable values stored in an Arena,
+   * most recently added first. Does not own its links, so copying it is
+   * shallow. */
+  template <typename T>
+  class ArenaList {
+
+    public:
+
+      struct Link {
+        T value;
+        Link* next;
+      };
+
+      ArenaList() : head_(NULL) {}
+
+      inline const Link* head() const { return head_; }
+
+      bool contains(const T& value) const {
+        for (const Link* link = head_; link != NULL; link = link->next) {
+          if (link->value == value) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      void push_front(Arena& arena, const T& value) {
+        Link* link = static_cast<Link*>(arena.allocate(sizeof(Link)));
+        new (&(link->value)) T(value);
+        link->next = head_;
+        head_ = link;
+      }
+
+    private:
+
+      Link* head_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_ARENA */
@@ -2,6 +2,7 @@
 #define BWI_GUIDANCE_SOLVER_COMMON_H
 
 #include <bwi_mapper/graph.h>
+#include <stdint.h>
 
 namespace bwi_guidance {
 
@@ -40,6 +41,20 @@ namespace bwi_guidance {
       const nav_msgs::OccupancyGrid& map,
       float visibility_range);
 
+  /* 64-bit FNV-1a hash of a buffer. Hashes over multiple buffers can be
+   * chained by passing in the previous hash. */
+  const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+  uint64_t hashBytes(const void* data, size_t size, 
+      uint64_t hash = FNV_OFFSET_BASIS);
+
+  /* Which states are merged when hashing and comparing states. ABSTRACT is
+   * the equivalence of the state operator== (which ignores robot positions
+   * in StateIROS14), while EXACT compares every member. */
+  enum StateEquivalence {
+    ABSTRACT_STATE_EQUIVALENCE = 0,
+    EXACT_STATE_EQUIVALENCE = 1
+  };
+
   void dashedLine(cv::Mat& image, cv::Point start, cv::Point goal,
       cv::Scalar color=cv::Scalar(0,0,0), int dash_width = 10, 
       int thickness=1, int linetype=4);
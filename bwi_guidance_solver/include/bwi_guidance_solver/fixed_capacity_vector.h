@@ -0,0 +1,114 @@
+#ifndef BWI_GUIDANCE_SOLVER_FIXED_CAPACITY_VECTOR
+#define BWI_GUIDANCE_SOLVER_FIXED_CAPACITY_VECTOR
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+namespace bwi_guidance {
+
+  /* A subset of the std::vector interface over inline storage for at most N
+   * elements of a POD type T. Copying one does not allocate, and is a plain
+   * copy of the struct. Unused slots are always value-initialized, so two
+   * vectors with equal contents are also equal bytewise (as long as T
+   * itself has no padding). Exceeding the capacity throws
+   * std::length_error. */
+  template <typename T, std::size_t N>
+  class FixedCapacityVector {
+
+    public:
+
+      typedef T value_type;
+      typedef T* iterator;
+      typedef const T* const_iterator;
+      typedef T& reference;
+      typedef const T& const_reference;
+      typedef std::size_t size_type;
+
+      FixedCapacityVector() : size_(0) {
+        std::fill(data_, data_ + N, T());
+      }
+
+      inline iterator begin() { return data_; }
+      inline iterator end() { return data_ + size_; }
+      inline const_iterator begin() const { return data_; }
+      inline const_iterator end() const { return data_ + size_; }
+
+      inline size_type size() const { return size_; }
+      inline bool empty() const { return size_ == 0; }
+      inline static size_type capacity() { return N; }
+
+      inline reference operator[](size_type i) { return data_[i]; }
+      inline const_reference operator[](size_type i) const { return data_[i]; }
+      inline reference front() { return data_[0]; }
+      inline const_reference front() const { return data_[0]; }
+      inline reference back() { return data_[size_ - 1]; }
+      inline const_reference back() const { return data_[size_ - 1]; }
+
+      inline void push_back(const T& value) {
+        if (size_ == N) {
+          throw std::length_error("FixedCapacityVector: capacity exceeded");
+        }
+        data_[size_++] = value;
+      }
+
+      inline void pop_back() {
+        data_[--size_] = T();
+      }
+
+      inline iterator erase(iterator position) {
+        std::copy(position + 1, end(), position);
+        pop_back();
+        return position;
+      }
+
+      inline void clear() {
+        std::fill(data_, data_ + size_, T());
+        size_ = 0;
+      }
+
+      inline void resize(size_type size, const T& value = T()) {
+        if (size > N) {
+          throw std::length_error("FixedCapacityVector: capacity exceeded");
+        }
+        if (size > size_) {
+          std::fill(data_ + size_, data_ + size, value);
+        } else {
+          std::fill(data_ + size, data_ + size_, T());
+        }
+        size_ = size;
+      }
+
+      template<class Archive>
+      void serialize(Archive &ar, const unsigned int version) {
+        ar & size_;
+        if (size_ > N) {
+          throw std::length_error("FixedCapacityVector: capacity exceeded");
+        }
+        for (size_type i = 0; i < size_; ++i) {
+          ar & data_[i];
+        }
+      }
+
+    private:
+
+      T data_[N];
+      size_type size_;
+
+  };
+
+  template <typename T, std::size_t N>
+  inline bool operator==(const FixedCapacityVector<T, N>& l,
+      const FixedCapacityVector<T, N>& r) {
+    return l.size() == r.size() && std::equal(l.begin(), l.end(), r.begin());
+  }
+
+  template <typename T, std::size_t N>
+  inline bool operator!=(const FixedCapacityVector<T, N>& l,
+      const FixedCapacityVector<T, N>& r) {
+    return !(l == r);
+  }
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_FIXED_CAPACITY_VECTOR */
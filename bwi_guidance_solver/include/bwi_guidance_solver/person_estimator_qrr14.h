@@ -2,10 +2,13 @@
 #define BWI_GUIDANCE_SOLVER_PERSON_ESTIMATOR_QRR14
 
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
 #include <stdexcept>
 #include <map>
+#include <vector>
 
 #include <rl_pursuit/planning/VIEstimator.h>
+#include <bwi_guidance_solver/person_model_qrr14.h>
 #include <bwi_guidance_solver/structures_qrr14.h>
 
 namespace boost {
@@ -16,16 +19,71 @@ namespace boost {
 
 namespace bwi_guidance {
 
+  /* What the estimator does when asked about a state it has no value (or
+   * best action) for. Misses never insert entries into the estimator. */
+  enum EstimatorMissPolicy {
+    MISS_RETURN_DEFAULT = 0, // default value, or a default constructed action
+    MISS_THROW = 1 // throw std::out_of_range
+  };
+
   class PersonEstimatorQRR14 : public VIEstimator<StateQRR14, ActionQRR14> {
     public:
 
-      PersonEstimatorQRR14 () {}
+      /* Values and best actions are stored in maps keyed by the state, so
+       * that any state can be stored */
+      PersonEstimatorQRR14(
+          EstimatorMissPolicy miss_policy = MISS_RETURN_DEFAULT,
+          float default_value = 0.0f);
+
+      /* Values and best actions are stored in flat arrays indexed by the
+       * dense state id of model. States outside the state space of model are
+       * always misses, and cannot be updated. */
+      PersonEstimatorQRR14(const boost::shared_ptr<PersonModelQRR14>& model,
+          EstimatorMissPolicy miss_policy = MISS_RETURN_DEFAULT,
+          float default_value = 0.0f);
+
       virtual ~PersonEstimatorQRR14 () {}
 
       virtual float getValue(const StateQRR14 &state);
       virtual void updateValue(const StateQRR14 &state, float value);
       virtual ActionQRR14 getBestAction(const StateQRR14 &state);
       virtual void setBestAction(const StateQRR14 &state, const ActionQRR14& action);
+      bool hasBestAction(const StateQRR14 &state) const;
+
+      /* Direct access by dense state id. Only available if the estimator was
+       * constructed with a model, and state_idx must be a valid state id of
+       * that model. */
+      inline bool isIndexed() const { return model_.get() != NULL; }
+      inline uint32_t getStateSpaceChecksum() const {
+        return model_->getStateSpaceChecksum();
+      }
+      inline float getValueByIndex(int state_idx) const {
+        if (miss_policy_ == MISS_THROW && !has_value_[state_idx]) {
+          throwMiss("value", state_idx);
+        }
+        return values_[state_idx];
+      }
+      inline void updateValueByIndex(int state_idx, float value) {
+        values_[state_idx] = value;
+        has_value_[state_idx] = 1;
+      }
+      inline bool hasBestActionByIndex(int state_idx) const {
+        return has_best_action_[state_idx];
+      }
+      inline ActionQRR14 getBestActionByIndex(int state_idx) const {
+        if (!hasBestActionByIndex(state_idx)) {
+          if (miss_policy_ == MISS_THROW) {
+            throwMiss("best action", state_idx);
+          }
+          return ActionQRR14();
+        }
+        return best_actions_[state_idx];
+      }
+      inline void setBestActionByIndex(int state_idx,
+          const ActionQRR14& action) {
+        best_actions_[state_idx] = action;
+        has_best_action_[state_idx] = 1;
+      }
 
       virtual void saveEstimatedValues(const std::string& file);
       virtual void loadEstimatedValues(const std::string& file);
@@ -36,14 +94,29 @@ namespace bwi_guidance {
 
     private:
 
+      void throwMiss(const std::string& what, int state_idx) const;
+      void throwMiss(const std::string& what, const StateQRR14& state) const;
+      void throwNotInStateSpace(const StateQRR14& state) const;
+
+      EstimatorMissPolicy miss_policy_;
+      float default_value_;
+
+      /* Map backend, also used as the serialization format of both
+       * backends */
       std::map<StateQRR14, float> value_cache_;
       std::map<StateQRR14, ActionQRR14> best_action_cache_;
 
+      /* Array backend */
+      boost::shared_ptr<PersonModelQRR14> model_;
+      std::vector<float> values_;
+      std::vector<unsigned char> has_value_;
+      std::vector<ActionQRR14> best_actions_;
+      std::vector<unsigned char> has_best_action_;
+
       friend class boost::serialization::access;
       template<class Archive>
       void serialize(Archive & ar, const unsigned int version);
 
-      float default_value_;
   };
 
 } /* bwi_guidance */
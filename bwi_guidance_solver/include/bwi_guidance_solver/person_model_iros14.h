@@ -5,6 +5,7 @@
 #include <rl_pursuit/planning/Model.h>
 #include <stdint.h>
 
+#include <bwi_guidance_solver/angle_tables.h>
 #include <bwi_guidance_solver/structures_iros14.h>
 #include <bwi_guidance_solver/utils.h>
 #include <bwi_mapper/graph.h>
@@ -17,7 +18,8 @@ namespace boost {
 
 namespace bwi_guidance {
 
-  const int ROBOT_HOME_BASE[] = {27, 25, 23, 37, 36, 45, 13, 42, 43, 8};
+  const int ROBOT_HOME_BASE[MAX_ROBOTS_IROS14] = 
+    {27, 25, 23, 37, 36, 45, 13, 42, 43, 8};
 
   class PersonModelIROS14 : public Model<StateIROS14, ActionIROS14> {
 
@@ -77,6 +79,11 @@ namespace bwi_guidance {
       std::map<int, std::vector<int> > visible_vertices_map_;
       std::map<int, std::vector<int> > action_vertices_map_;
 
+      /* Precomputed angles and human motion model weights */
+      GraphAngleTable angle_table_;
+      MotionWeightTable motion_weights_;
+      MotionWeightTable directed_motion_weights_;
+
       /* Actions */
       bool isTerminalState(const StateIROS14& state) const;
 
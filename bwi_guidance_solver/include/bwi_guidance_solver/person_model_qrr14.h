@@ -4,18 +4,14 @@
 #include <nav_msgs/OccupancyGrid.h>
 #include <rl_pursuit/planning/Model.h>
 #include <rl_pursuit/planning/PredictiveModel.h>
+#include <boost/shared_ptr.hpp>
 #include <stdint.h>
 
+#include <bwi_guidance_solver/angle_tables.h>
 #include <bwi_guidance_solver/structures_qrr14.h>
 #include <bwi_guidance_solver/utils.h>
 #include <bwi_mapper/graph.h>
 
-namespace boost {
-  namespace serialization {
-    class access;
-  }
-}
-
 namespace bwi_guidance {
 
   enum RewardStructure {
@@ -24,18 +20,63 @@ namespace bwi_guidance {
     SHAPING_REWARD = 2
   };
 
+  /* Goal independent structures of PersonModelQRR14: the state space and its
+   * dense index, the actions at each state, and the layout of the transition
+   * table. These are computed once and shared (read only) between models
+   * constructed for different goals. */
+  struct PersonModelStructureQRR14 {
+
+    std::map<int, std::vector<int> > adjacent_vertices_map;
+    std::map<int, std::vector<int> > visible_vertices_map;
+    std::vector<StateQRR14> state_cache;
+
+    /* Dense state index. initializeStateSpace() lays out states vertex by
+     * vertex, and within a vertex by direction, robots left, robot
+     * direction and visible robot. These tables allow computing the
+     * position of a state in state_cache directly from its fields. */
+    std::vector<int> vertex_state_offset;
+    std::vector<int> vertex_robots_block_size;
+    std::vector<int> vertex_visible_block_size;
+    std::vector<int> adjacent_position; // num_vertices * num_vertices
+    std::vector<int> visible_position; // num_vertices * num_vertices
+
+    /* Fingerprint of the state space layout (FNV-1a over state_cache), used
+     * to check that data indexed by state id belongs to this state space */
+    uint32_t state_space_checksum;
+
+    /* Actions at state id s are stored in action_cache[action_offset[s]] to
+     * action_cache[action_offset[s+1]] */
+    std::vector<ActionQRR14> action_cache;
+    std::vector<unsigned int> action_offset;
+
+    /* The transitions for the global action index a are stored in
+     * [transition_offset[a], transition_offset[a+1]) of a model's transition
+     * table */
+    std::vector<unsigned int> transition_offset;
+  };
+
   class PersonModelQRR14 : public PredictiveModel<StateQRR14, ActionQRR14>,
                            public Model<StateQRR14, ActionQRR14> {
 
     public:
 
+      /* If file is not empty, it is used as a model cache (see
+       * loadModelCache()). The transition table is computed over
+       * num_threads threads (0 uses all available cores). */
       PersonModelQRR14(const bwi_mapper::Graph& graph, 
           const nav_msgs::OccupancyGrid& map, size_t goal_idx, 
           const std::string& file = "", bool allow_robot_current_idx = false,
           float visibility_range = 0.0f, bool allow_goal_visibility = false,
           unsigned int max_robots = 5, float success_reward = 0.0f,
           RewardStructure reward_structure = STANDARD_REWARD,
-          bool use_importance_sampling = false);
+          bool use_importance_sampling = false,
+          unsigned int num_threads = 0);
+
+      /* Constructs a model for a different goal, sharing all goal independent
+       * structures with model. Only the transition table is copied, and the
+       * rows that depend on the goal (rewards, and transition probabilities
+       * near the goal if goal visibility is allowed) are recomputed. */
+      PersonModelQRR14(const PersonModelQRR14& model, size_t goal_idx);
 
       /* Functions inherited from PredictiveModel */
       virtual bool isTerminalState(const StateQRR14& state) const;
@@ -68,51 +109,104 @@ namespace bwi_guidance {
       void getNextStates(const StateQRR14& state, const ActionQRR14& action, 
           std::vector<StateQRR14>& next_states);
 
+      /* Dense state indexing - returns the position of the state in the
+       * vector produced by getStateVector(), or -1 if state is not valid */
+      int getStateIndex(const StateQRR14& state) const;
+      inline unsigned int getNumStates() const { 
+        return structure_->state_cache.size(); 
+      }
+      inline const StateQRR14& getState(int state_idx) const {
+        return structure_->state_cache[state_idx];
+      }
+      inline uint32_t getStateSpaceChecksum() const {
+        return structure_->state_space_checksum;
+      }
+
+      /* Zero-copy access to the precomputed transition table. Actions at a
+       * state are addressed by a global action index in the range
+       * [getActionsBegin(s), getActionsEnd(s)), and the transitions for an
+       * action are in [getTransitionsBegin(a), getTransitionsEnd(a)). Rows
+       * are present for terminal states as well (so that the layout can be
+       * shared between goals), and should be ignored by callers. */
+      inline unsigned int getActionsBegin(int state_idx) const {
+        return structure_->action_offset[state_idx];
+      }
+      inline unsigned int getActionsEnd(int state_idx) const {
+        return structure_->action_offset[state_idx + 1];
+      }
+      inline const ActionQRR14& getAction(unsigned int action_idx) const {
+        return structure_->action_cache[action_idx];
+      }
+      inline const TransitionQRR14* getTransitionsBegin(
+          unsigned int action_idx) const {
+        return &transition_cache_[0] + 
+          structure_->transition_offset[action_idx];
+      }
+      inline const TransitionQRR14* getTransitionsEnd(
+          unsigned int action_idx) const {
+        return &transition_cache_[0] + 
+          structure_->transition_offset[action_idx + 1];
+      }
+      int getActionIndex(int state_idx, const ActionQRR14& action) const;
+
+      inline size_t getGoalIdx() const { return goal_idx_; }
+
     private:
 
       /* Current state for generative model */
       StateQRR14 current_state_;
+      int current_state_idx_;
       URGenPtr generator_;
       std::vector<float> intrinsic_reward_cache_;
       RewardStructure reward_structure_;
       float success_reward_;
       bool use_importance_sampling_;
 
-      /* StateQRR14 space cache */
-      std::map<int, std::vector<int> > adjacent_vertices_map_;
-      std::map<int, std::vector<int> > visible_vertices_map_;
-      std::vector<StateQRR14> state_cache_;
-      void initializeStateSpace();
+      /* Precomputed angles and motion model weights for graph_, shared with
+       * models constructed for other goals */
+      boost::shared_ptr<const GraphAngleTable> angle_table_;
+      boost::shared_ptr<const MotionWeightTable> motion_weights_;
 
-      /* Actions cache */
+      /* Goal independent structures, possibly shared with other models */
+      boost::shared_ptr<PersonModelStructureQRR14> structure_;
+      void initializeStateSpace();
+      void initializeStateIndex();
       void initializeActionCache();
       void constructActionsAtState(const StateQRR14& state, 
           std::vector<ActionQRR14>& actions);
-      std::vector<ActionQRR14>& getActionsAtState(const StateQRR14 &state);
-      std::map<StateQRR14, std::vector<ActionQRR14> > action_cache_;
 
-      /* Next states and transitions cache */
+      /* Next states and transitions cache - the transitions for the global
+       * action index a are stored in 
+       * transition_cache_[structure_->transition_offset[a]] to
+       * transition_cache_[structure_->transition_offset[a+1]] */
       void initializeNextStateCache();
-      std::map<StateQRR14, std::map<ActionQRR14, std::vector<float> > > 
-        ns_distribution_cache_;
+      void constructTransitionBlock(unsigned int start_idx, 
+          unsigned int end_idx, std::vector<TransitionQRR14>& transitions,
+          std::string& error);
+      std::vector<TransitionQRR14> transition_cache_;
+      void constructNextStates(const StateQRR14& state, 
+          const ActionQRR14& action, std::vector<StateQRR14>& next_states);
       void constructTransitionProbabilities(const StateQRR14& state, 
           const ActionQRR14& action, std::vector<float>& probabilities);
-      std::vector<float>& getTransitionProbabilities(const StateQRR14& state,
-          const ActionQRR14& action);
+      void initializeGoalTransitions(size_t previous_goal_idx);
+
+      /* Rewards depend on the reward structure, and are re-derived in place
+       * whenever it changes */
+      void initializeRewardCache();
+
+      /* Model cache. The goal independent structures and the transition
+       * table are stored in a flat binary file along with a key identifying
+       * the graph, map and parameters used to compute them, and a checksum of
+       * the contents. A cache that does not match is ignored and rewritten.
+       * A cache computed for a different goal can still be used, as the goal
+       * dependent parts are recomputed on load. */
+      uint64_t computeCacheKey() const;
+      bool loadModelCache(const std::string& file);
+      void saveModelCache(const std::string& file) const;
 
       unsigned int num_vertices_;
       unsigned int max_robots_;
-
-      friend class boost::serialization::access;
-      template<class Archive>
-      void serialize(Archive & ar, const unsigned int version) {
-        ar & BOOST_SERIALIZATION_NVP(adjacent_vertices_map_);
-        ar & BOOST_SERIALIZATION_NVP(visible_vertices_map_);
-        ar & BOOST_SERIALIZATION_NVP(state_cache_);
-        ar & BOOST_SERIALIZATION_NVP(action_cache_);
-        ar & BOOST_SERIALIZATION_NVP(ns_distribution_cache_);
-        ar & num_vertices_;
-      }
+      unsigned int num_threads_;
 
       bwi_mapper::Graph graph_;
       nav_msgs::OccupancyGrid map_;
@@ -124,10 +218,14 @@ namespace bwi_guidance {
       float visibility_range_;
 
   };
+
+  /* Model cache file in directory for the given model parameters, so that
+   * models computed with different parameters keep separate caches. The
+   * graph and map are only checked through the cache key. */
+  std::string getModelCacheFileQRR14(const std::string& directory,
+      bool allow_robot_current_idx, float visibility_range,
+      bool allow_goal_visibility, unsigned int max_robots = 5);
   
 } /* bwi_guidance */
 
-BOOST_CLASS_TRACKING(bwi_guidance::PersonModelQRR14, 
-    boost::serialization::track_never)
-
 #endif /* end of include guard: BWI_GUIDANCE_SOLVER_PERSON_MODEL_QRR14 */
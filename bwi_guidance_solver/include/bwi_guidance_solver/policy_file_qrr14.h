@@ -0,0 +1,95 @@
+#ifndef BWI_GUIDANCE_SOLVER_POLICY_FILE_QRR14
+#define BWI_GUIDANCE_SOLVER_POLICY_FILE_QRR14
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <bwi_guidance_solver/person_estimator_qrr14.h>
+#include <bwi_guidance_solver/person_model_qrr14.h>
+
+namespace bwi_guidance {
+
+  /* Flat policy file format. A policy file contains, in native byte order:
+   *  - PolicyFileHeaderQRR14
+   *  - float values[num_states]
+   *  - PolicyFileActionQRR14 actions[num_states]
+   * where both arrays are indexed by the dense state id of PersonModelQRR14.
+   * The file can be memory mapped read-only, so that loading is constant time
+   * and the pages are shared between all processes using the same policy. */
+
+  const char POLICY_FILE_MAGIC[8] = {'Q', 'R', 'R', '1', '4', 'P', 'O', 'L'};
+  const uint32_t POLICY_FILE_VERSION = 1;
+
+  struct PolicyFileHeaderQRR14 {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_states;
+    uint32_t state_space_checksum; // see getStateSpaceChecksum()
+    uint32_t reserved;
+  };
+
+  struct PolicyFileActionQRR14 {
+    int32_t type; // ActionType, or NONE if no action is available
+    int32_t graph_id;
+  };
+
+  /* Returns true if file starts with the flat policy file magic */
+  bool isPolicyFileQRR14(const std::string& file);
+
+  void writePolicyFileQRR14(const std::string& file,
+      uint32_t state_space_checksum, const std::vector<float>& values,
+      const std::vector<PolicyFileActionQRR14>& actions);
+
+  /* Writes the policy held by estimator for every state in model */
+  void savePolicyFileQRR14(const std::string& file,
+      const PersonModelQRR14& model, PersonEstimatorQRR14& estimator);
+
+  /* Read-only view of a memory mapped policy file */
+  class MappedPolicyQRR14 {
+
+    public:
+
+      /* Throws std::runtime_error if the file cannot be mapped, or is not a
+       * valid policy file */
+      explicit MappedPolicyQRR14(const std::string& file);
+
+      inline unsigned int getNumStates() const {
+        return header_->num_states;
+      }
+      inline uint32_t getStateSpaceChecksum() const {
+        return header_->state_space_checksum;
+      }
+      inline float getValue(int state_idx) const {
+        return values_[state_idx];
+      }
+      /* Returns false if no action was stored for this state */
+      inline bool getBestAction(int state_idx, ActionQRR14& action) const {
+        const PolicyFileActionQRR14& entry = actions_[state_idx];
+        if (entry.type == NONE) {
+          return false;
+        }
+        action = ActionQRR14((ActionType) entry.type, entry.graph_id);
+        return true;
+      }
+
+      /* Throws std::runtime_error if this policy was not computed for the
+       * state space of model */
+      void checkModel(const PersonModelQRR14& model) const;
+
+    private:
+
+      boost::interprocess::file_mapping file_;
+      boost::interprocess::mapped_region region_;
+
+      const PolicyFileHeaderQRR14* header_;
+      const float* values_;
+      const PolicyFileActionQRR14* actions_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_POLICY_FILE_QRR14 */
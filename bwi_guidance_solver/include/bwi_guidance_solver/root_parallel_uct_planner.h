@@ -0,0 +1,142 @@
+#ifndef BWI_GUIDANCE_SOLVER_ROOT_PARALLEL_UCT_PLANNER
+#define BWI_GUIDANCE_SOLVER_ROOT_PARALLEL_UCT_PLANNER
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <bwi_guidance_solver/search_planner.h>
+#include <bwi_guidance_solver/uct_planner.h>
+
+namespace bwi_guidance {
+
+  /* Root parallel UCT. Searches one independent UCTPlanner tree per model,
+   * each on its own thread, and selects the world action by merging the
+   * root statistics of all trees. Generative models keep their current
+   * state and random number generators, so every tree needs a separate
+   * model instance (with separately seeded generators). */
+  template <class State, class Action>
+  class RootParallelUCTPlanner : public SearchPlanner<State, Action> {
+
+    public:
+
+      RootParallelUCTPlanner(
+          const std::vector<boost::shared_ptr<Model<State, Action> > >& models,
+          const UCTPlannerParams& params, unsigned int seed) {
+        if (models.empty()) {
+          throw std::runtime_error("RootParallelUCTPlanner: no models");
+        }
+        for (unsigned int t = 0; t < models.size(); ++t) {
+          trees_.push_back(boost::shared_ptr<UCTPlanner<State, Action> >(
+                new UCTPlanner<State, Action>(models[t], params, seed + t)));
+        }
+      }
+
+      virtual ~RootParallelUCTPlanner() {}
+
+      /* Searches all trees in parallel. Returns the total number of playouts
+       * and terminations over all trees. */
+      virtual unsigned int search(const State& state,
+          unsigned int& terminations) {
+        unsigned int num_trees = trees_.size();
+        std::vector<unsigned int> tree_playouts(num_trees, 0);
+        std::vector<unsigned int> tree_terminations(num_trees, 0);
+        std::vector<std::string> tree_errors(num_trees);
+
+        boost::thread_group threads;
+        for (unsigned int t = 1; t < num_trees; ++t) {
+          threads.create_thread(boost::bind(
+                &RootParallelUCTPlanner::searchTree, this, t,
+                boost::cref(state), boost::ref(tree_playouts[t]),
+                boost::ref(tree_terminations[t]), boost::ref(tree_errors[t])));
+        }
+        searchTree(0, state, tree_playouts[0], tree_terminations[0],
+            tree_errors[0]);
+        threads.join_all();
+
+        unsigned int playouts = 0;
+        terminations = 0;
+        for (unsigned int t = 0; t < num_trees; ++t) {
+          if (!tree_errors[t].empty()) {
+            throw std::runtime_error(tree_errors[t]);
+          }
+          playouts += tree_playouts[t];
+          terminations += tree_terminations[t];
+        }
+        return playouts;
+      }
+
+      /* Action with the highest value at state, where the value of an action
+       * is its visit weighted mean value over all trees */
+      virtual Action selectWorldAction(const State& state) {
+        std::map<Action, std::pair<unsigned int, float> > merged;
+        std::vector<Action> actions;
+        std::vector<unsigned int> visits;
+        std::vector<float> values;
+        for (unsigned int t = 0; t < trees_.size(); ++t) {
+          trees_[t]->getActionStatistics(state, actions, visits, values);
+          for (unsigned int a = 0; a < actions.size(); ++a) {
+            std::pair<unsigned int, float>& stats = merged[actions[a]];
+            stats.first += visits[a];
+            stats.second += visits[a] * values[a];
+          }
+        }
+
+        bool found = false;
+        Action best_action;
+        float best_value = 0.0f;
+        for (typename std::map<Action, std::pair<unsigned int, float> >::
+            const_iterator it = merged.begin(); it != merged.end(); ++it) {
+          if (it->second.first == 0) {
+            continue;
+          }
+          float value = it->second.second / it->second.first;
+          if (!found || value > best_value) {
+            found = true;
+            best_action = it->first;
+            best_value = value;
+          }
+        }
+        if (!found) {
+          return trees_[0]->selectWorldAction(state);
+        }
+        return best_action;
+      }
+
+      virtual void restart() {
+        for (unsigned int t = 0; t < trees_.size(); ++t) {
+          trees_[t]->restart();
+        }
+      }
+
+      virtual void reroot(const State& state) {
+        for (unsigned int t = 0; t < trees_.size(); ++t) {
+          trees_[t]->reroot(state);
+        }
+      }
+
+      inline unsigned int getNumTrees() const { return trees_.size(); }
+
+    private:
+
+      void searchTree(unsigned int tree, const State& state,
+          unsigned int& playouts, unsigned int& terminations,
+          std::string& error) {
+        try {
+          playouts = trees_[tree]->search(state, terminations);
+        } catch (const std::exception& e) {
+          error = e.what();
+        }
+      }
+
+      std::vector<boost::shared_ptr<UCTPlanner<State, Action> > > trees_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_ROOT_PARALLEL_UCT_PLANNER */
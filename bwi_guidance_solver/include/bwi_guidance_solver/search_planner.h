@@ -0,0 +1,35 @@
+#ifndef BWI_GUIDANCE_SOLVER_SEARCH_PLANNER
+#define BWI_GUIDANCE_SOLVER_SEARCH_PLANNER
+
+namespace bwi_guidance {
+
+  /* Online planner that searches from the current world state in slices,
+   * and then selects the action to take in the world. */
+  template <class State, class Action>
+  class SearchPlanner {
+
+    public:
+
+      virtual ~SearchPlanner() {}
+
+      /* Searches from state for one slice. Returns the number of playouts,
+       * and the number of playouts that reached a terminal state in
+       * terminations. */
+      virtual unsigned int search(const State& state,
+          unsigned int& terminations) = 0;
+
+      virtual Action selectWorldAction(const State& state) = 0;
+
+      /* Discards everything learnt by previous searches */
+      virtual void restart() = 0;
+
+      /* Called after the world moved to state. Keeps whatever previous
+       * searches learnt about the states reachable from state, and discards
+       * the rest. */
+      virtual void reroot(const State& state) = 0;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_SEARCH_PLANNER */
@@ -6,6 +6,7 @@
 #include <ostream>
 
 #include <bwi_guidance_solver/common.h>
+#include <bwi_guidance_solver/fixed_capacity_vector.h>
 #include <bwi_mapper/graph.h>
 
 namespace boost {
@@ -45,6 +46,12 @@ namespace bwi_guidance {
   std::ostream& operator<<(std::ostream& stream, const ActionIROS14& a);
 
   /* States */
+
+  /* Maximum number of robots in a state. This also bounds the number of
+   * robots in use, and the number of locations acquired or relieved between
+   * two WAIT actions. */
+  const std::size_t MAX_ROBOTS_IROS14 = 10;
+
   struct RobotStateIROS14 {
     int graph_id; //~50
     int destination; //~50
@@ -89,12 +96,14 @@ namespace bwi_guidance {
 
     bool robot_gave_direction;
 
-    std::vector<RobotStateIROS14> robots; // ~10 * 50 * 50
-    std::vector<InUseRobotStateIROS14> in_use_robots; // ~10 * 20 * 5
+    /* Inline storage, so that copying a state does not allocate */
+    FixedCapacityVector<RobotStateIROS14, MAX_ROBOTS_IROS14> robots; // ~10 * 50 * 50
+    FixedCapacityVector<InUseRobotStateIROS14, MAX_ROBOTS_IROS14> 
+      in_use_robots; // ~10 * 20 * 5
 
     /* These just prevent bad action choices */
-    std::vector<int> acquired_locations;
-    std::vector<int> relieved_locations;
+    FixedCapacityVector<int, MAX_ROBOTS_IROS14> acquired_locations;
+    FixedCapacityVector<int, MAX_ROBOTS_IROS14> relieved_locations;
 
     friend class boost::serialization::access;
     template<class Archive>
@@ -110,6 +119,15 @@ namespace bwi_guidance {
   bool operator==(const StateIROS14& l, const StateIROS14& r);
   std::ostream& operator<<(std::ostream& stream, const StateIROS14& s);
 
+  /* Hash and equality of states under either equivalence. The abstract
+   * equivalence matches operator==, and ignores the robot positions, the
+   * precision and the ids of the robots in use. hash_value() makes the state
+   * usable with boost::hash, and is consistent with operator==. */
+  uint64_t hashState(const StateIROS14& s, StateEquivalence equivalence);
+  bool equalStates(const StateIROS14& l, const StateIROS14& r, 
+      StateEquivalence equivalence);
+  std::size_t hash_value(const StateIROS14& s);
+
 } /* bwi_guidance */
 
 #endif /* end of include guard: BWI_GUIDANCE_SOLVER_STRUCTURES_IROS14 */
@@ -66,6 +66,22 @@ namespace bwi_guidance {
   bool operator==(const StateQRR14& l, const StateQRR14& r);
   std::ostream& operator<<(std::ostream& stream, const StateQRR14& s);
 
+  /* Hash and equality of states. Every member of StateQRR14 is part of the
+   * state, so both equivalences are the same as operator==. */
+  uint64_t hashState(const StateQRR14& s, StateEquivalence equivalence);
+  bool equalStates(const StateQRR14& l, const StateQRR14& r, 
+      StateEquivalence equivalence);
+  std::size_t hash_value(const StateQRR14& s);
+
+  /* Transitions - a single entry in a row of the precomputed transition table,
+   * identifying the next state by its dense state index */
+
+  struct TransitionQRR14 {
+    int next_state_idx;
+    float probability;
+    float reward;
+  };
+
 } /* bwi_guidance */
 
 #endif /* end of include guard: STRUCTURES_HDY3OBT2 */
@@ -0,0 +1,260 @@
+#ifndef BWI_GUIDANCE_SOLVER_TRANSPOSITION_TABLE
+#define BWI_GUIDANCE_SOLVER_TRANSPOSITION_TABLE
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include <bwi_guidance_solver/common.h>
+
+namespace bwi_guidance {
+
+  /* Hashes and compares states with the hashState() and equalStates()
+   * overloads of the state type, under the given equivalence. */
+  template <typename State>
+  class StateKeyTraits {
+
+    public:
+
+      explicit StateKeyTraits(
+          StateEquivalence equivalence = ABSTRACT_STATE_EQUIVALENCE) :
+        equivalence_(equivalence) {}
+
+      inline uint64_t hash(const State& state) const {
+        return hashState(state, equivalence_);
+      }
+      inline bool equal(const State& l, const State& r) const {
+        return equalStates(l, r, equivalence_);
+      }
+      inline StateEquivalence getEquivalence() const { return equivalence_; }
+
+    private:
+
+      StateEquivalence equivalence_;
+
+  };
+
+  /* Open addressing hash table (linear probing) from keys to values. The
+   * probe sequence compares the full 64-bit hash before comparing keys, so
+   * that most key comparisons are avoided. Entries are stored in insertion
+   * order outside of the probe array, so references to keys and values
+   * remain valid until clear() is called, even when the table grows.
+   * Entries cannot be erased individually. clear() takes constant time: the
+   * storage of cleared entries is reused by assigning over it, and slots are
+   * only occupied if they carry the current generation. */
+  template <typename Key, typename Value,
+           typename KeyTraits = StateKeyTraits<Key> >
+  class TranspositionTable {
+
+    public:
+
+      typedef Key key_type;
+      typedef Value value_type;
+
+      explicit TranspositionTable(const KeyTraits& traits = KeyTraits(),
+          std::size_t initial_capacity = 1024) : traits_(traits), size_(0),
+        generation_(1) {
+        std::size_t capacity = MIN_CAPACITY;
+        while (capacity < 2 * initial_capacity) {
+          capacity *= 2;
+        }
+        slots_.resize(capacity);
+      }
+
+      inline std::size_t size() const { return size_; }
+      inline bool empty() const { return size_ == 0; }
+      inline std::size_t getNumSlots() const { return slots_.size(); }
+      inline const KeyTraits& getKeyTraits() const { return traits_; }
+
+      /* NULL if the key is not in the table */
+      inline Value* find(const Key& key) {
+        Slot& slot = slots_[findSlot(key, traits_.hash(key))];
+        return (!isOccupied(slot)) ? NULL : &(entries_[slot.entry].value);
+      }
+      inline const Value* find(const Key& key) const {
+        const Slot& slot = slots_[findSlot(key, traits_.hash(key))];
+        return (!isOccupied(slot)) ? NULL : &(entries_[slot.entry].value);
+      }
+
+      /* Entry of key, returns false if the key is not in the table */
+      inline bool findEntry(const Key& key, std::size_t& entry) const {
+        const Slot& slot = slots_[findSlot(key, traits_.hash(key))];
+        entry = slot.entry;
+        return isOccupied(slot);
+      }
+
+      /* Returns the value of key, inserting a default constructed value if
+       * key was not present */
+      inline Value& insert(const Key& key, bool& inserted) {
+        std::size_t entry;
+        return insert(key, inserted, entry);
+      }
+
+      Value& insert(const Key& key, bool& inserted, std::size_t& entry) {
+        uint64_t hash = traits_.hash(key);
+        std::size_t slot_idx = findSlot(key, hash);
+        if (isOccupied(slots_[slot_idx])) {
+          inserted = false;
+          entry = slots_[slot_idx].entry;
+          return entries_[entry].value;
+        }
+
+        inserted = true;
+        if (2 * (size_ + 1) > slots_.size()) {
+          grow();
+          slot_idx = findSlot(key, hash);
+        }
+        entry = size_;
+        occupy(slots_[slot_idx], hash, entry);
+        if (size_ < entries_.size()) {
+          entries_[size_] = Entry(key, hash);
+        } else {
+          entries_.push_back(Entry(key, hash));
+        }
+        ++size_;
+        return entries_[entry].value;
+      }
+
+      /* Entries in insertion order, 0 <= entry < size() */
+      inline const Key& getKey(std::size_t entry) const {
+        return entries_[entry].key;
+      }
+      inline Value& getValue(std::size_t entry) {
+        return entries_[entry].value;
+      }
+      inline const Value& getValue(std::size_t entry) const {
+        return entries_[entry].value;
+      }
+
+      /* Removes all entries, but keeps the current number of slots and the
+       * entry storage */
+      void clear() {
+        size_ = 0;
+        nextGeneration();
+      }
+
+      /* Removes every entry for which keep is 0, keeping the relative order
+       * of the remaining entries. new_entry maps every old entry to its new
+       * entry, or to NO_ENTRY if it was removed. References to the kept
+       * values are invalidated. The kept entries are compacted in place. */
+      void retain(const std::vector<unsigned char>& keep,
+          std::vector<std::size_t>& new_entry) {
+        std::size_t kept = 0;
+        new_entry.assign(size_, NO_ENTRY);
+        for (std::size_t entry = 0; entry < size_; ++entry) {
+          if (keep[entry]) {
+            new_entry[entry] = kept;
+            if (kept != entry) {
+              entries_[kept] = entries_[entry];
+            }
+            ++kept;
+          }
+        }
+        size_ = kept;
+
+        nextGeneration();
+        std::size_t mask = slots_.size() - 1;
+        for (std::size_t entry = 0; entry < size_; ++entry) {
+          std::size_t slot_idx = entries_[entry].hash & mask;
+          while (isOccupied(slots_[slot_idx])) {
+            slot_idx = (slot_idx + 1) & mask;
+          }
+          occupy(slots_[slot_idx], entries_[entry].hash, entry);
+        }
+      }
+
+      static const std::size_t NO_ENTRY = static_cast<std::size_t>(-1);
+
+    private:
+
+      static const uint32_t EMPTY = 0xFFFFFFFF;
+      static const std::size_t MIN_CAPACITY = 16;
+
+      /* A slot is empty unless its generation is the current one */
+      struct Slot {
+        Slot() : hash(0), entry(EMPTY), generation(0) {}
+        uint64_t hash;
+        uint32_t entry;
+        uint32_t generation;
+      };
+
+      struct Entry {
+        Entry(const Key& key, uint64_t hash) : key(key), value(), hash(hash) {}
+        Key key;
+        Value value;
+        uint64_t hash;
+      };
+
+      /* Slot containing key, or the empty slot where it should be inserted.
+       * The load factor is at most 0.5, so there always is an empty slot. */
+      inline std::size_t findSlot(const Key& key, uint64_t hash) const {
+        std::size_t mask = slots_.size() - 1;
+        std::size_t slot_idx = hash & mask;
+        while (true) {
+          const Slot& slot = slots_[slot_idx];
+          if (!isOccupied(slot)) {
+            return slot_idx;
+          }
+          if (slot.hash == hash && traits_.equal(entries_[slot.entry].key, key)) {
+            return slot_idx;
+          }
+          slot_idx = (slot_idx + 1) & mask;
+        }
+      }
+
+      /* Doubles the number of slots. The stored hashes are reused, so no key
+       * is hashed or compared again. */
+      void grow() {
+        std::vector<Slot> old_slots(2 * slots_.size());
+        old_slots.swap(slots_);
+        std::size_t mask = slots_.size() - 1;
+        for (std::size_t i = 0; i < old_slots.size(); ++i) {
+          if (isOccupied(old_slots[i])) {
+            std::size_t slot_idx = old_slots[i].hash & mask;
+            while (isOccupied(slots_[slot_idx])) {
+              slot_idx = (slot_idx + 1) & mask;
+            }
+            slots_[slot_idx] = old_slots[i];
+          }
+        }
+      }
+
+      inline bool isOccupied(const Slot& slot) const {
+        return slot.generation == generation_;
+      }
+
+      inline void occupy(Slot& slot, uint64_t hash, std::size_t entry) {
+        slot.hash = hash;
+        slot.entry = entry;
+        slot.generation = generation_;
+      }
+
+      /* Empties all slots. Only touches them when the generation wraps. */
+      void nextGeneration() {
+        ++generation_;
+        if (generation_ == 0) {
+          std::fill(slots_.begin(), slots_.end(), Slot());
+          generation_ = 1;
+        }
+      }
+
+      KeyTraits traits_;
+      std::vector<Slot> slots_;
+      std::deque<Entry> entries_; // entries at size_ and beyond are unused
+      std::size_t size_;
+      uint32_t generation_;
+
+  };
+
+  template <typename Key, typename Value, typename KeyTraits>
+  const std::size_t TranspositionTable<Key, Value, KeyTraits>::NO_ENTRY;
+  template <typename Key, typename Value, typename KeyTraits>
+  const uint32_t TranspositionTable<Key, Value, KeyTraits>::EMPTY;
+  template <typename Key, typename Value, typename KeyTraits>
+  const std::size_t TranspositionTable<Key, Value, KeyTraits>::MIN_CAPACITY;
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_TRANSPOSITION_TABLE */
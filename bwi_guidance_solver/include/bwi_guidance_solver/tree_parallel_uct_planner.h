@@ -0,0 +1,563 @@
+#ifndef BWI_GUIDANCE_SOLVER_TREE_PARALLEL_UCT_PLANNER
+#define BWI_GUIDANCE_SOLVER_TREE_PARALLEL_UCT_PLANNER
+
+#include <stdint.h>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <rl_pursuit/planning/Model.h>
+#include <bwi_guidance_solver/arena.h>
+#include <bwi_guidance_solver/search_planner.h>
+#include <bwi_guidance_solver/transposition_table.h>
+#include <bwi_guidance_solver/uct_planner.h>
+
+namespace bwi_guidance {
+
+  /* Tree parallel UCT. All threads descend a single search tree (stored in
+   * a transposition table as in UCTPlanner), each with its own copy of the
+   * generative model. Visit counts and value sums are updated with atomic
+   * operations, and actions that are being explored by other threads
+   * receive a virtual loss, so that threads spread over different parts of
+   * the tree. Every action records the nodes of the next states seen after
+   * it in a list that is only ever prepended to, so descending along a
+   * known transition follows that list without any lock. Only the first
+   * time a transition is seen, the table lock is taken to look up or insert
+   * the next state and record it. The node storage arena is only allocated
+   * from under that lock. The threads other than the calling one are
+   * started once, and wait for the next search() in between. */
+  template <class State, class Action>
+  class TreeParallelUCTPlanner : public SearchPlanner<State, Action> {
+
+    public:
+
+      /* One search thread per model. virtual_loss is the value assumed for
+       * every playout still in flight through an action (typically
+       * -params.reward_bound). */
+      TreeParallelUCTPlanner(
+          const std::vector<boost::shared_ptr<Model<State, Action> > >& models,
+          const UCTPlannerParams& params, float virtual_loss,
+          unsigned int seed) : models_(models), params_(params),
+      virtual_loss_(virtual_loss),
+      table_(StateKeyTraits<State>(params.equivalence),
+          params.initial_table_size),
+      arena_(params.arena_block_size), spare_arena_(params.arena_block_size),
+      search_state_(NULL), root_(NULL), search_count_(0), active_workers_(0),
+      stopping_(false), thread_terminations_(models.size(), 0),
+      thread_errors_(models.size()) {
+        if (models_.empty()) {
+          throw std::runtime_error("TreeParallelUCTPlanner: no models");
+        }
+        for (unsigned int t = 0; t < models_.size(); ++t) {
+          rngs_.push_back(boost::shared_ptr<boost::mt19937>(
+                new boost::mt19937(seed + t)));
+        }
+        for (unsigned int t = 1; t < models_.size(); ++t) {
+          workers_.create_thread(boost::bind(
+                &TreeParallelUCTPlanner::workerThread, this, t));
+        }
+      }
+
+      virtual ~TreeParallelUCTPlanner() {
+        {
+          boost::mutex::scoped_lock lock(workers_mutex_);
+          stopping_ = true;
+        }
+        workers_condition_.notify_all();
+        workers_.join_all();
+      }
+
+      /* Searches from state with all threads until max_playouts (in total)
+       * or max_planning_time is reached */
+      virtual unsigned int search(const State& state,
+          unsigned int& terminations) {
+        unsigned int num_threads = models_.size();
+        std::fill(thread_terminations_.begin(), thread_terminations_.end(), 0);
+        std::fill(thread_errors_.begin(), thread_errors_.end(), std::string());
+        playouts_ = 0;
+        search_state_ = &state;
+        root_ = getNode(*(models_[0]), state, NULL);
+        start_time_ = boost::posix_time::microsec_clock::local_time();
+
+        {
+          boost::mutex::scoped_lock lock(workers_mutex_);
+          active_workers_ = num_threads - 1;
+          ++search_count_;
+        }
+        workers_condition_.notify_all();
+        searchThread(0, state, thread_terminations_[0], thread_errors_[0]);
+        {
+          boost::mutex::scoped_lock lock(workers_mutex_);
+          while (active_workers_ != 0) {
+            workers_condition_.wait(lock);
+          }
+        }
+
+        terminations = 0;
+        for (unsigned int t = 0; t < num_threads; ++t) {
+          if (!thread_errors_[t].empty()) {
+            throw std::runtime_error(thread_errors_[t]);
+          }
+          terminations += thread_terminations_[t];
+        }
+        return playouts_;
+      }
+
+      /* Action with the highest mean value at state */
+      virtual Action selectWorldAction(const State& state) {
+        StateNode* node = findNode(state);
+        int best_action = -1;
+        float best_value = 0.0f;
+        if (node != NULL) {
+          for (unsigned int a = 0; a < node->actions.size(); ++a) {
+            const ActionNode& action_node = node->actions[a];
+            int completed = getCompletedVisits(action_node);
+            if (completed <= 0) {
+              continue;
+            }
+            float value = action_node.value_sum / completed;
+            if (best_action == -1 || value > best_value) {
+              best_action = a;
+              best_value = value;
+            }
+          }
+        }
+        if (best_action == -1) {
+          Action action;
+          models_[0]->getFirstAction(state, action);
+          return action;
+        }
+        return node->actions[best_action].action;
+      }
+
+      /* Discards the search tree, in constant time. Must not be called
+       * during search(). */
+      virtual void restart() {
+        table_.clear();
+        arena_.reset();
+      }
+
+      /* Keeps only the part of the search tree reachable from state. Must not
+       * be called during search(). */
+      virtual void reroot(const State& state) {
+        StateNode* root = table_.find(state);
+        if (root == NULL) {
+          restart();
+          return;
+        }
+
+        // Find the reachable nodes, and record their next states by entry,
+        // as the nodes move when the table is compacted
+        std::vector<unsigned char> keep(table_.size(), 0);
+        std::vector<StateNode*> queue(1, root);
+        std::vector<unsigned int> num_children;
+        std::vector<std::size_t> children;
+        keep[root->entry] = 1;
+        for (std::size_t q = 0; q < queue.size(); ++q) {
+          const StateNode& node = *(queue[q]);
+          for (unsigned int a = 0; a < node.actions.size(); ++a) {
+            unsigned int count = 0;
+            for (const ChildLink* link = node.actions[a].children;
+                link != NULL; link = link->next) {
+              if (!keep[link->node->entry]) {
+                keep[link->node->entry] = 1;
+                queue.push_back(link->node);
+              }
+              children.push_back(link->node->entry);
+              ++count;
+            }
+            num_children.push_back(count);
+          }
+        }
+        std::vector<std::size_t> old_entries(queue.size());
+        for (std::size_t q = 0; q < queue.size(); ++q) {
+          old_entries[q] = queue[q]->entry;
+        }
+
+        std::vector<std::size_t> new_entry;
+        table_.retain(keep, new_entry);
+        spare_arena_.reset();
+        std::size_t child = 0;
+        std::size_t action = 0;
+        for (std::size_t q = 0; q < old_entries.size(); ++q) {
+          std::size_t entry = new_entry[old_entries[q]];
+          StateNode& node = table_.getValue(entry);
+          node.entry = entry;
+          node.key = &(table_.getKey(entry));
+          node.actions.assign(spare_arena_, node.actions.data(),
+              node.actions.size());
+          for (unsigned int a = 0; a < node.actions.size(); ++a, ++action) {
+            ActionNode& action_node = node.actions[a];
+            action_node.children = NULL;
+            for (unsigned int c = 0; c < num_children[action]; ++c, ++child) {
+              addChild(spare_arena_, action_node,
+                  &(table_.getValue(new_entry[children[child]])));
+            }
+          }
+        }
+        arena_.swap(spare_arena_);
+        spare_arena_.reset();
+      }
+
+      inline unsigned int getNumThreads() const { return models_.size(); }
+      inline std::size_t getNumStates() const { return table_.size(); }
+
+    private:
+
+      struct StateNode;
+
+      /* Stored in arena_, and never modified once published */
+      struct ChildLink {
+        StateNode* node;
+        const ChildLink* next;
+      };
+
+      struct ActionNode {
+        Action action;
+        volatile unsigned int visits; // including playouts in flight
+        volatile unsigned int in_flight;
+        volatile double value_sum; // over completed playouts
+        const ChildLink* volatile children; // nodes of the next states seen
+      };
+
+      struct StateNode {
+        StateNode() : visits(0), hash(0), key(NULL), entry(0) {}
+        volatile unsigned int visits;
+        uint64_t hash;
+        const State* key; // stored in the table
+        std::size_t entry;
+        ArenaArray<ActionNode> actions; // constant once inserted
+      };
+
+      struct Visit {
+        StateNode* node;
+        unsigned int action;
+        float reward;
+      };
+
+      /* Visits is incremented after in_flight when a playout starts, and
+       * in_flight is read first here, so that concurrent playouts can only
+       * make this an overestimate by the number of starting playouts.
+       * Callers should skip actions where this is not positive. */
+      static inline int getCompletedVisits(const ActionNode& action_node) {
+        int in_flight = action_node.in_flight;
+        int visits = action_node.visits;
+        return visits - in_flight;
+      }
+
+      static inline void atomicIncrement(volatile unsigned int* value) {
+        __sync_fetch_and_add(value, 1);
+      }
+
+      static inline void atomicDecrement(volatile unsigned int* value) {
+        __sync_fetch_and_sub(value, 1);
+      }
+
+      /* Compare and swap on the bit pattern of the double */
+      static inline void atomicAdd(volatile double* value, double delta) {
+        volatile uint64_t* bits = reinterpret_cast<volatile uint64_t*>(value);
+        while (true) {
+          uint64_t old_bits = *bits;
+          double old_value, new_value;
+          std::memcpy(&old_value, &old_bits, sizeof(double));
+          new_value = old_value + delta;
+          uint64_t new_bits;
+          std::memcpy(&new_bits, &new_value, sizeof(double));
+          if (__sync_bool_compare_and_swap(bits, old_bits, new_bits)) {
+            return;
+          }
+        }
+      }
+
+      /* Runs searchThread once for every call to search(), until the
+       * planner is destroyed */
+      void workerThread(unsigned int thread) {
+        unsigned int search_count = 0;
+        while (true) {
+          {
+            boost::mutex::scoped_lock lock(workers_mutex_);
+            while (!stopping_ && search_count_ == search_count) {
+              workers_condition_.wait(lock);
+            }
+            if (stopping_) {
+              return;
+            }
+            search_count = search_count_;
+          }
+          searchThread(thread, *search_state_, thread_terminations_[thread],
+              thread_errors_[thread]);
+          {
+            boost::mutex::scoped_lock lock(workers_mutex_);
+            --active_workers_;
+          }
+          workers_condition_.notify_all();
+        }
+      }
+
+      void searchThread(unsigned int thread, const State& state,
+          unsigned int& terminations, std::string& error) {
+        try {
+          std::vector<Visit> history;
+          while (true) {
+            if (params_.max_playouts != 0) {
+              // Reserve a playout
+              if (__sync_fetch_and_add(&playouts_, 1) >= params_.max_playouts) {
+                __sync_fetch_and_sub(&playouts_, 1);
+                break;
+              }
+            }
+            if (params_.max_planning_time != 0.0f) {
+              boost::posix_time::time_duration elapsed =
+                boost::posix_time::microsec_clock::local_time() - start_time_;
+              if (elapsed.total_microseconds() >=
+                  1e6f * params_.max_planning_time) {
+                if (params_.max_playouts != 0) {
+                  __sync_fetch_and_sub(&playouts_, 1);
+                }
+                break;
+              }
+            }
+            if (params_.max_playouts == 0 &&
+                params_.max_planning_time == 0.0f) {
+              break;
+            }
+            if (playout(thread, state, history)) {
+              ++terminations;
+            }
+            if (params_.max_playouts == 0) {
+              __sync_fetch_and_add(&playouts_, 1);
+            }
+          }
+        } catch (const std::exception& e) {
+          error = e.what();
+        }
+      }
+
+      /* Returns true if the playout reached a terminal state */
+      bool playout(unsigned int thread, const State& start_state,
+          std::vector<Visit>& history) {
+        Model<State, Action>& model = *(models_[thread]);
+        model.setState(start_state);
+        history.clear();
+
+        StateNode* node = root_;
+        bool terminal = false;
+        unsigned int depth = 0;
+        try {
+          while (params_.max_depth == 0 || depth < params_.max_depth) {
+            Visit visit;
+            visit.node = node;
+            visit.action = selectPlanningAction(*(rngs_[thread]), *node);
+
+            // Count the visit now, with a virtual loss until it completes
+            ActionNode& action_node = node->actions[visit.action];
+            atomicIncrement(&(action_node.in_flight));
+            atomicIncrement(&(action_node.visits));
+            atomicIncrement(&(node->visits));
+            history.push_back(visit);
+
+            State next_state;
+            int depth_count;
+            model.takeAction(action_node.action, history.back().reward,
+                next_state, terminal, depth_count);
+            depth += depth_count;
+            if (terminal) {
+              break;
+            }
+            node = getNode(model, next_state, &action_node);
+          }
+        } catch (...) {
+          // Remove the virtual losses of this playout before giving up
+          for (unsigned int i = 0; i < history.size(); ++i) {
+            ActionNode& action_node =
+              history[i].node->actions[history[i].action];
+            atomicDecrement(&(history[i].node->visits));
+            atomicDecrement(&(action_node.visits));
+            atomicDecrement(&(action_node.in_flight));
+          }
+          throw;
+        }
+
+        // Back up the lambda-return through the visited states, replacing
+        // the virtual losses with the actual returns
+        float next_return = (terminal) ? 0.0f : getStateValue(*node);
+        for (int i = history.size() - 1; i >= 0; --i) {
+          const Visit& visit = history[i];
+          ActionNode& action_node = visit.node->actions[visit.action];
+          float target = visit.reward + params_.gamma * next_return;
+          atomicAdd(&(action_node.value_sum), target);
+          atomicDecrement(&(action_node.in_flight));
+          next_return = params_.lambda * target +
+            (1.0f - params_.lambda) * getStateValue(*visit.node);
+        }
+
+        return terminal;
+      }
+
+      StateNode* findNode(const State& state) {
+        boost::mutex::scoped_lock lock(table_mutex_);
+        return table_.find(state);
+      }
+
+      /* Next state of parent that is equivalent to state, NULL if there is
+       * none yet. Does not need the table lock: links are only prepended
+       * once fully written, and the nodes they point to never move during
+       * search(). */
+      StateNode* findChild(const ActionNode& parent, const State& state,
+          uint64_t hash) const {
+        for (const ChildLink* link = parent.children; link != NULL;
+            link = link->next) {
+          if (link->node->hash == hash &&
+              table_.getKeyTraits().equal(*(link->node->key), state)) {
+            return link->node;
+          }
+        }
+        return NULL;
+      }
+
+      /* Publishes the link only after it has been written. Callers hold the
+       * table lock (or are the only thread), so there is a single writer. */
+      static void addChild(Arena& arena, ActionNode& parent, StateNode* node) {
+        ChildLink* link = static_cast<ChildLink*>(
+            arena.allocate(sizeof(ChildLink)));
+        link->node = node;
+        link->next = parent.children;
+        __sync_synchronize();
+        parent.children = link;
+      }
+
+      /* Node of state, recorded as a next state of parent (if any). Known
+       * next states of parent are found without locking. Otherwise the
+       * state is looked up (or inserted, with its action list filled in)
+       * and recorded under the table lock. Nodes never move during search(),
+       * so the returned node can be used without holding the lock. */
+      StateNode* getNode(Model<State, Action>& model, const State& state,
+          ActionNode* parent) {
+        uint64_t hash = table_.getKeyTraits().hash(state);
+        if (parent != NULL) {
+          StateNode* node = findChild(*parent, state, hash);
+          if (node != NULL) {
+            return node;
+          }
+        }
+
+        boost::mutex::scoped_lock lock(table_mutex_);
+        bool inserted;
+        std::size_t entry;
+        StateNode& node = table_.insert(state, inserted, entry);
+        if (inserted) {
+          node.hash = hash;
+          node.key = &(table_.getKey(entry));
+          node.entry = entry;
+          ActionNode action_node;
+          action_node.visits = 0;
+          action_node.in_flight = 0;
+          action_node.value_sum = 0.0;
+          action_node.children = NULL;
+          actions_.clear();
+          model.getFirstAction(state, action_node.action);
+          do {
+            actions_.push_back(action_node);
+          } while (model.getNextAction(state, action_node.action));
+          node.actions.assign(arena_, &actions_[0], actions_.size());
+        }
+        // Another thread may have recorded it since the unlocked lookup
+        if (parent != NULL && findChild(*parent, state, hash) == NULL) {
+          addChild(arena_, *parent, &node);
+        }
+        return &node;
+      }
+
+      /* UCB1 on the values including virtual losses, trying every action
+       * once first. Ties are broken randomly. */
+      unsigned int selectPlanningAction(boost::mt19937& rng,
+          const StateNode& node) {
+        unsigned int state_visits = node.visits;
+        float log_visits = (state_visits > 0) ? log(state_visits) : 0.0f;
+        float best_value = -std::numeric_limits<float>::max();
+        unsigned int num_best = 0;
+        unsigned int best_action = 0;
+        for (unsigned int a = 0; a < node.actions.size(); ++a) {
+          const ActionNode& action_node = node.actions[a];
+          unsigned int visits = action_node.visits;
+          float value;
+          if (visits == 0) {
+            value = std::numeric_limits<float>::max();
+          } else {
+            value = (action_node.value_sum +
+                action_node.in_flight * virtual_loss_) / visits +
+              params_.reward_bound * sqrtf(log_visits / visits);
+          }
+          if (value > best_value) {
+            best_value = value;
+            best_action = a;
+            num_best = 1;
+          } else if (value == best_value) {
+            // Reservoir sampling among the tied actions
+            ++num_best;
+            if (rng() % num_best == 0) {
+              best_action = a;
+            }
+          }
+        }
+        return best_action;
+      }
+
+      /* Highest mean value over the completed playouts at the node */
+      float getStateValue(const StateNode& node) const {
+        bool found = false;
+        float value = 0.0f;
+        for (unsigned int a = 0; a < node.actions.size(); ++a) {
+          const ActionNode& action_node = node.actions[a];
+          int completed = getCompletedVisits(action_node);
+          if (completed <= 0) {
+            continue;
+          }
+          float action_value = action_node.value_sum / completed;
+          if (!found || action_value > value) {
+            found = true;
+            value = action_value;
+          }
+        }
+        return value;
+      }
+
+      std::vector<boost::shared_ptr<Model<State, Action> > > models_;
+      std::vector<boost::shared_ptr<boost::mt19937> > rngs_;
+      UCTPlannerParams params_;
+      float virtual_loss_;
+
+      boost::mutex table_mutex_;
+      TranspositionTable<State, StateNode> table_;
+      Arena arena_; // action arrays and next state lists of the nodes
+      Arena spare_arena_; // target of the copy when rerooting
+      std::vector<ActionNode> actions_; // scratch space for new nodes
+
+      volatile unsigned int playouts_;
+      boost::posix_time::ptime start_time_;
+      const State* search_state_;
+      StateNode* root_;
+
+      boost::thread_group workers_; // threads 1 and up
+      boost::mutex workers_mutex_;
+      boost::condition_variable workers_condition_;
+      unsigned int search_count_; // number of calls to search() so far
+      unsigned int active_workers_;
+      bool stopping_;
+      std::vector<unsigned int> thread_terminations_;
+      std::vector<std::string> thread_errors_;
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_TREE_PARALLEL_UCT_PLANNER */
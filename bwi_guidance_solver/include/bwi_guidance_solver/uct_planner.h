@@ -0,0 +1,348 @@
+#ifndef BWI_GUIDANCE_SOLVER_UCT_PLANNER
+#define BWI_GUIDANCE_SOLVER_UCT_PLANNER
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <rl_pursuit/planning/Model.h>
+#include <bwi_guidance_solver/arena.h>
+#include <bwi_guidance_solver/common.h>
+#include <bwi_guidance_solver/search_planner.h>
+#include <bwi_guidance_solver/transposition_table.h>
+
+namespace bwi_guidance {
+
+  struct UCTPlannerParams {
+    UCTPlannerParams() : gamma(1.0f), lambda(0.0f), reward_bound(1.0f),
+    max_depth(0), max_playouts(0), max_planning_time(0.1f),
+    equivalence(ABSTRACT_STATE_EQUIVALENCE), initial_table_size(1024),
+    arena_block_size(1 << 20) {}
+
+    float gamma;
+    float lambda; // eligibility of the rollout return over the state value
+    float reward_bound; // scales the UCB exploration term
+    unsigned int max_depth; // sum of the model depth counts, 0 = unlimited
+    unsigned int max_playouts; // per call to search(), 0 = unlimited
+    float max_planning_time; // seconds per call to search(), 0 = unlimited
+    StateEquivalence equivalence; // which states share a node
+    unsigned int initial_table_size; // expected number of nodes
+    unsigned int arena_block_size; // bytes per block of node storage
+  };
+
+  /* Records entry as one of the next states seen after action_node */
+  template <class ActionNode>
+  inline void addChild(Arena& arena, ActionNode& action_node,
+      std::size_t entry) {
+    if (!action_node.children.contains(entry)) {
+      action_node.children.push_front(arena, entry);
+    }
+  }
+
+  /* Removes every node of a UCT transposition table that cannot be reached
+   * from the node at root_entry through the recorded next states, and
+   * renumbers the next states of the remaining nodes. The action arrays and
+   * next state lists of the remaining nodes are copied from arena into
+   * spare_arena, after which the two arenas are swapped and spare_arena is
+   * reset, releasing the storage of all removed nodes at once. */
+  template <class Table>
+  void pruneUnreachableNodes(Table& table, std::size_t root_entry,
+      Arena& arena, Arena& spare_arena) {
+    typedef typename Table::value_type StateNode;
+    typedef typename StateNode::ChildList ChildList;
+
+    std::vector<unsigned char> keep(table.size(), 0);
+    std::vector<std::size_t> queue(1, root_entry);
+    keep[root_entry] = 1;
+    for (std::size_t q = 0; q < queue.size(); ++q) {
+      const StateNode& node = table.getValue(queue[q]);
+      for (unsigned int a = 0; a < node.actions.size(); ++a) {
+        for (const typename ChildList::Link* link =
+            node.actions[a].children.head(); link != NULL; link = link->next) {
+          if (!keep[link->value]) {
+            keep[link->value] = 1;
+            queue.push_back(link->value);
+          }
+        }
+      }
+    }
+
+    std::vector<std::size_t> new_entry;
+    table.retain(keep, new_entry);
+    spare_arena.reset();
+    for (std::size_t entry = 0; entry < table.size(); ++entry) {
+      StateNode& node = table.getValue(entry);
+      node.actions.assign(spare_arena, node.actions.data(),
+          node.actions.size());
+      for (unsigned int a = 0; a < node.actions.size(); ++a) {
+        ChildList children = node.actions[a].children;
+        node.actions[a].children = ChildList();
+        for (const typename ChildList::Link* link = children.head();
+            link != NULL; link = link->next) {
+          node.actions[a].children.push_front(spare_arena,
+              new_entry[link->value]);
+        }
+      }
+    }
+    arena.swap(spare_arena);
+    spare_arena.reset();
+  }
+
+  /* UCT over a generative Model, with the search tree stored as a
+   * transposition table of state nodes. All states that are equivalent
+   * (under params.equivalence) share a single node and its statistics, so
+   * the "tree" is really a graph. Every state visited in a playout gets a
+   * node. Values are backed up as lambda-returns. Action arrays and next
+   * state lists of the nodes live in an Arena, so that restart() only
+   * rewinds the arena and the table instead of freeing every node. */
+  template <class State, class Action>
+  class UCTPlanner : public SearchPlanner<State, Action> {
+
+    public:
+
+      UCTPlanner(const boost::shared_ptr<Model<State, Action> >& model,
+          const UCTPlannerParams& params, unsigned int seed) :
+        model_(model), params_(params), rng_(seed),
+        table_(StateKeyTraits<State>(params.equivalence),
+            params.initial_table_size),
+        arena_(params.arena_block_size), spare_arena_(params.arena_block_size)
+        {}
+
+      virtual ~UCTPlanner() {}
+
+      /* Runs playouts from start_state until max_playouts or
+       * max_planning_time is reached. Returns the number of playouts, and
+       * the number of playouts that reached a terminal state in
+       * terminations. */
+      virtual unsigned int search(const State& start_state,
+          unsigned int& terminations) {
+        boost::posix_time::ptime start_time =
+          boost::posix_time::microsec_clock::local_time();
+        unsigned int playouts = 0;
+        terminations = 0;
+        while (true) {
+          if (params_.max_playouts != 0 && playouts >= params_.max_playouts) {
+            break;
+          }
+          if (params_.max_planning_time != 0.0f) {
+            boost::posix_time::time_duration elapsed =
+              boost::posix_time::microsec_clock::local_time() - start_time;
+            if (elapsed.total_microseconds() >=
+                1e6f * params_.max_planning_time) {
+              break;
+            }
+          }
+          if (params_.max_playouts == 0 &&
+              params_.max_planning_time == 0.0f) {
+            break;
+          }
+          if (playout(start_state)) {
+            ++terminations;
+          }
+          ++playouts;
+        }
+        return playouts;
+      }
+
+      /* Action with the highest value at state. If the state has never been
+       * searched, the first action of the model is returned. */
+      virtual Action selectWorldAction(const State& state) {
+        StateNode* node = table_.find(state);
+        if (node == NULL || node->visits == 0) {
+          Action action;
+          model_->getFirstAction(state, action);
+          return action;
+        }
+        int best_action = -1;
+        for (unsigned int a = 0; a < node->actions.size(); ++a) {
+          const ActionNode& action_node = node->actions[a];
+          if (action_node.visits == 0) {
+            continue;
+          }
+          if (best_action == -1 ||
+              action_node.value > node->actions[best_action].value) {
+            best_action = a;
+          }
+        }
+        return node->actions[best_action].action;
+      }
+
+      /* Discards the search tree, in constant time */
+      virtual void restart() {
+        table_.clear();
+        arena_.reset();
+      }
+
+      /* Keeps only the part of the search tree reachable from state */
+      virtual void reroot(const State& state) {
+        std::size_t root_entry;
+        if (!table_.findEntry(state, root_entry)) {
+          restart();
+          return;
+        }
+        pruneUnreachableNodes(table_, root_entry, arena_, spare_arena_);
+      }
+
+      /* Actions at state, with their visit counts and values. All empty if
+       * state has not been visited by any playout. */
+      void getActionStatistics(const State& state,
+          std::vector<Action>& actions, std::vector<unsigned int>& visits,
+          std::vector<float>& values) const {
+        actions.clear();
+        visits.clear();
+        values.clear();
+        const StateNode* node = table_.find(state);
+        if (node == NULL) {
+          return;
+        }
+        for (unsigned int a = 0; a < node->actions.size(); ++a) {
+          actions.push_back(node->actions[a].action);
+          visits.push_back(node->actions[a].visits);
+          values.push_back(node->actions[a].value);
+        }
+      }
+
+      inline std::size_t getNumStates() const { return table_.size(); }
+      inline std::size_t getArenaBytes() const {
+        return arena_.getBytesAllocated();
+      }
+      inline const UCTPlannerParams& getParams() const { return params_; }
+
+    private:
+
+      struct ActionNode {
+        Action action;
+        unsigned int visits;
+        float value;
+        ArenaList<std::size_t> children; // entries of the next states seen
+      };
+
+      struct StateNode {
+        typedef ArenaList<std::size_t> ChildList;
+        StateNode() : visits(0) {}
+        unsigned int visits;
+        ArenaArray<ActionNode> actions;
+      };
+
+      struct Visit {
+        StateNode* node;
+        unsigned int action;
+        float reward;
+      };
+
+      /* Returns true if the playout reached a terminal state */
+      bool playout(const State& start_state) {
+        model_->setState(start_state);
+        history_.clear();
+
+        std::size_t entry;
+        StateNode* node = &getNode(start_state, entry);
+        bool terminal = false;
+        unsigned int depth = 0;
+        while (params_.max_depth == 0 || depth < params_.max_depth) {
+          Visit visit;
+          visit.node = node;
+          visit.action = selectPlanningAction(*node);
+          State next_state;
+          int depth_count;
+          model_->takeAction(node->actions[visit.action].action,
+              visit.reward, next_state, terminal, depth_count);
+          history_.push_back(visit);
+          depth += depth_count;
+          if (terminal) {
+            break;
+          }
+          ActionNode& action_node = node->actions[visit.action];
+          node = &getNode(next_state, entry);
+          addChild(arena_, action_node, entry);
+        }
+
+        // Back up the lambda-return through the visited states
+        float next_return = (terminal) ? 0.0f : getStateValue(*node);
+        for (int i = history_.size() - 1; i >= 0; --i) {
+          const Visit& visit = history_[i];
+          ActionNode& action_node = visit.node->actions[visit.action];
+          float target = visit.reward + params_.gamma * next_return;
+          ++(visit.node->visits);
+          ++(action_node.visits);
+          action_node.value +=
+            (target - action_node.value) / action_node.visits;
+          next_return = params_.lambda * target +
+            (1.0f - params_.lambda) * getStateValue(*visit.node);
+        }
+
+        return terminal;
+      }
+
+      StateNode& getNode(const State& state, std::size_t& entry) {
+        bool inserted;
+        StateNode& node = table_.insert(state, inserted, entry);
+        if (inserted) {
+          ActionNode action_node;
+          action_node.visits = 0;
+          action_node.value = 0.0f;
+          actions_.clear();
+          model_->getFirstAction(state, action_node.action);
+          do {
+            actions_.push_back(action_node);
+          } while (model_->getNextAction(state, action_node.action));
+          node.actions.assign(arena_, &actions_[0], actions_.size());
+        }
+        return node;
+      }
+
+      /* UCB1, trying every action once first. Ties are broken randomly. */
+      unsigned int selectPlanningAction(const StateNode& node) {
+        float log_visits = (node.visits > 0) ? log(node.visits) : 0.0f;
+        float best_value = -std::numeric_limits<float>::max();
+        unsigned int num_best = 0;
+        unsigned int best_action = 0;
+        for (unsigned int a = 0; a < node.actions.size(); ++a) {
+          const ActionNode& action_node = node.actions[a];
+          float value = (action_node.visits == 0) ?
+            std::numeric_limits<float>::max() :
+            action_node.value + params_.reward_bound *
+            sqrtf(log_visits / action_node.visits);
+          if (value > best_value) {
+            best_value = value;
+            best_action = a;
+            num_best = 1;
+          } else if (value == best_value) {
+            // Reservoir sampling among the tied actions
+            ++num_best;
+            if (rng_() % num_best == 0) {
+              best_action = a;
+            }
+          }
+        }
+        return best_action;
+      }
+
+      float getStateValue(const StateNode& node) const {
+        float value = -std::numeric_limits<float>::max();
+        for (unsigned int a = 0; a < node.actions.size(); ++a) {
+          if (node.actions[a].visits != 0 && node.actions[a].value > value) {
+            value = node.actions[a].value;
+          }
+        }
+        return (node.visits == 0) ? 0.0f : value;
+      }
+
+      boost::shared_ptr<Model<State, Action> > model_;
+      UCTPlannerParams params_;
+      boost::mt19937 rng_;
+      TranspositionTable<State, StateNode> table_;
+      Arena arena_; // action arrays and next state lists of the nodes
+      Arena spare_arena_; // target of the copy when rerooting
+      std::vector<Visit> history_;
+      std::vector<ActionNode> actions_; // scratch space for new nodes
+
+  };
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_UCT_PLANNER */
@@ -0,0 +1,142 @@
+#ifndef BWI_GUIDANCE_SOLVER_VALUE_ITERATION_QRR14
+#define BWI_GUIDANCE_SOLVER_VALUE_ITERATION_QRR14
+
+#include <boost/function.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/shared_ptr.hpp>
+#include <limits>
+#include <vector>
+
+#include <bwi_guidance_solver/person_estimator_qrr14.h>
+#include <bwi_guidance_solver/person_model_qrr14.h>
+#include <bwi_guidance_solver/policy_file_qrr14.h>
+
+namespace bwi_guidance {
+
+  enum ValueIterationMode {
+    SYNCHRONOUS_SWEEP = 0,
+    PRIORITIZED_SWEEP = 1
+  };
+
+  /* Value iteration over PersonModelQRR14 that works directly on the model's
+   * dense state indices and precomputed transition table. Each sweep is a
+   * Jacobi update (all backups read the values from the previous sweep), so
+   * states can be partitioned across threads and the computed policy does
+   * not depend on the number of threads used. The interface mirrors
+   * rl_pursuit's ValueIteration so it can be used as a drop-in replacement.
+   *
+   * In PRIORITIZED_SWEEP mode, backups are instead performed in place
+   * (single threaded). States are first backed up once in order of their
+   * distance (in transitions) from the goal, after which only states whose
+   * Bellman residual may still exceed epsilon are backed up, largest
+   * residual first. */
+  class ValueIterationQRR14 {
+
+    public:
+
+      ValueIterationQRR14(const boost::shared_ptr<PersonModelQRR14>& model,
+          const boost::shared_ptr<PersonEstimatorQRR14>& estimator,
+          float gamma = 1.0, float epsilon = 1e-2,
+          unsigned int max_iter = 1000,
+          float max_value = std::numeric_limits<float>::max(),
+          float min_value = -std::numeric_limits<float>::max(),
+          unsigned int num_threads = 0,
+          ValueIterationMode mode = SYNCHRONOUS_SWEEP);
+
+      void computePolicy();
+      ActionQRR14 getBestAction(const StateQRR14& state);
+
+      /* loadPolicy() accepts both the estimator's serialized format and the
+       * flat policy format (see policy_file_qrr14.h). Flat policy files are
+       * memory mapped, and the estimator is not populated in that case. */
+      void loadPolicy(const std::string& file);
+      void savePolicy(const std::string& file);
+      void saveFlatPolicy(const std::string& file);
+
+      inline unsigned int getNumThreads() const { return num_threads_; }
+      inline ValueIterationMode getMode() const { return mode_; }
+      inline const boost::shared_ptr<PersonModelQRR14>& getModel() const {
+        return model_;
+      }
+      inline const boost::shared_ptr<PersonEstimatorQRR14>& 
+        getEstimator() const {
+        return estimator_;
+      }
+
+      /* Statistics from the last call to computePolicy(). A sweep is
+       * counted as getNumStates() backups in the prioritized mode. The
+       * residual history holds the largest residual at the end of each
+       * sweep. */
+      inline unsigned long getNumBackups() const { return num_backups_; }
+      inline float getNumSweeps() const { 
+        return (values_.size() == 0) ? 0.0f : 
+          (float) num_backups_ / values_.size();
+      }
+      inline const std::vector<float>& getResidualHistory() const {
+        return residual_history_;
+      }
+
+    private:
+
+      void computePolicySynchronous();
+      void computePolicyPrioritized();
+
+      /* Computes [start_idx, end_idx) in every synchronous sweep, until
+       * sweeps_done is set */
+      void runSweepWorker(unsigned int start_idx, unsigned int end_idx,
+          float& max_change, boost::barrier& sweep_barrier,
+          const bool& sweeps_done);
+      void computeValues(unsigned int start_idx, unsigned int end_idx,
+          float& max_change);
+      /* Returns the clamped Bellman backup of a non-terminal state using the
+       * values in values_, or values_[state_idx] if no action is available */
+      float backupState(int state_idx, int& best_action) const;
+
+      boost::shared_ptr<PersonModelQRR14> model_;
+      boost::shared_ptr<PersonEstimatorQRR14> estimator_;
+      boost::shared_ptr<MappedPolicyQRR14> mapped_policy_;
+
+      float gamma_;
+      float epsilon_;
+      unsigned int max_iter_;
+      float max_value_;
+      float min_value_;
+      unsigned int num_threads_;
+      ValueIterationMode mode_;
+
+      /* Values from the previous sweep, and values/actions being computed in
+       * the current sweep, indexed by dense state id */
+      std::vector<float> values_;
+      std::vector<float> next_values_;
+      std::vector<int> best_actions_;
+
+      unsigned long num_backups_;
+      std::vector<float> residual_history_;
+
+  };
+
+  typedef boost::function<void (const boost::shared_ptr<ValueIterationQRR14>&)>
+    GoalPolicyCallback;
+
+  /* Computes a policy for each goal in goals. The goal independent
+   * structures of model are built once and shared by the model for every
+   * goal (see PersonModelQRR14(const PersonModelQRR14&, size_t)), and the
+   * reward structure of model is used for all goals. Goals are solved in
+   * parallel over num_threads threads (0 uses all available cores). 
+   *
+   * callback is called once per goal as soon as its policy is computed, from
+   * the thread that computed it, and must be thread safe. The model for a
+   * goal (other than model itself) is released once the callback returns,
+   * so that at most num_threads transition tables are held at once. */
+  void computePoliciesForGoals(
+      const boost::shared_ptr<PersonModelQRR14>& model,
+      const std::vector<int>& goals, const GoalPolicyCallback& callback,
+      float gamma = 1.0, float epsilon = 1e-2, unsigned int max_iter = 1000,
+      float max_value = std::numeric_limits<float>::max(),
+      float min_value = -std::numeric_limits<float>::max(),
+      unsigned int num_threads = 0, 
+      ValueIterationMode mode = SYNCHRONOUS_SWEEP);
+
+} /* bwi_guidance */
+
+#endif /* end of include guard: BWI_GUIDANCE_SOLVER_VALUE_ITERATION_QRR14 */
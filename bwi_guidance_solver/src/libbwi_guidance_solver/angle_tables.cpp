@@ -0,0 +1,70 @@
+#include <cmath>
+
+#include <bwi_guidance_solver/angle_tables.h>
+
+namespace bwi_guidance {
+
+  double getMotionWeight(float angle, float expected_dir, double sigma_sq) {
+    float angle_difference = getAbsoluteAngleDifference(angle, expected_dir);
+    return std::exp(-std::pow((double) angle_difference, 2.0) / 
+        (2 * sigma_sq));
+  }
+
+  GraphAngleTable::GraphAngleTable(const bwi_mapper::Graph& graph) :
+    num_vertices_(boost::num_vertices(graph)) {
+
+    node_angle_.resize(num_vertices_ * num_vertices_);
+    direction_.resize(num_vertices_ * num_vertices_);
+    for (int u = 0; u < num_vertices_; ++u) {
+      for (int v = 0; v < num_vertices_; ++v) {
+        float angle = bwi_mapper::getNodeAngle(u, v, graph);
+        node_angle_[u * num_vertices_ + v] = angle;
+        direction_[u * num_vertices_ + v] = getDiscretizedAngle(angle);
+      }
+    }
+
+    direction_angle_.resize(NUM_DIRECTIONS);
+    for (int dir = 0; dir < NUM_DIRECTIONS; ++dir) {
+      direction_angle_[dir] = getAngleInRadians(dir);
+    }
+
+    adjacent_vertices_.resize(num_vertices_);
+    adjacent_position_.assign(num_vertices_ * num_vertices_, -1);
+    for (int u = 0; u < num_vertices_; ++u) {
+      std::vector<size_t> adjacent_vertices;
+      bwi_mapper::getAdjacentNodes(u, graph, adjacent_vertices);
+      adjacent_vertices_[u] =
+        std::vector<int>(adjacent_vertices.begin(), adjacent_vertices.end());
+      for (int i = 0; i < adjacent_vertices_[u].size(); ++i) {
+        adjacent_position_[u * num_vertices_ + adjacent_vertices_[u][i]] = i;
+      }
+    }
+  }
+
+  MotionWeightTable::MotionWeightTable(const GraphAngleTable& angles,
+      double sigma_sq) {
+
+    unsigned int num_vertices = angles.getNumVertices();
+    offset_.resize(num_vertices);
+    row_size_.resize(num_vertices);
+    for (int u = 0; u < num_vertices; ++u) {
+      const std::vector<int>& adjacent_vertices =
+        angles.getAdjacentVertices(u);
+      offset_[u] = weights_.size();
+      row_size_[u] = NUM_DIRECTIONS + adjacent_vertices.size();
+      for (int i = 0; i < adjacent_vertices.size(); ++i) {
+        float next_direction = angles.getNodeAngle(u, adjacent_vertices[i]);
+        // Expected to move in one of the discretized directions, followed by
+        // expected to move towards one of the adjacent vertices
+        for (int r = 0; r < row_size_[u]; ++r) {
+          float expected_dir = (r < NUM_DIRECTIONS) ?
+            angles.getDirectionAngle(r) :
+            angles.getNodeAngle(u, adjacent_vertices[r - NUM_DIRECTIONS]);
+          weights_.push_back(
+              getMotionWeight(next_direction, expected_dir, sigma_sq));
+        }
+      }
+    }
+  }
+
+} /* bwi_guidance */
@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include <bwi_guidance_solver/arena.h>
+
+namespace bwi_guidance {
+
+  const std::size_t Arena::ALIGNMENT;
+
+  Arena::Arena(std::size_t block_size) : block_size_(block_size),
+    current_block_(0), offset_(0), bytes_allocated_(0) {}
+
+  Arena::~Arena() {
+    for (std::size_t b = 0; b < blocks_.size(); ++b) {
+      delete[] blocks_[b];
+    }
+  }
+
+  void* Arena::allocate(std::size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    // Move on to the next block with enough space, allocating one if needed
+    while (current_block_ < blocks_.size() &&
+        offset_ + size > block_sizes_[current_block_]) {
+      ++current_block_;
+      offset_ = 0;
+    }
+    if (current_block_ == blocks_.size()) {
+      std::size_t new_block_size = std::max(block_size_, size);
+      blocks_.push_back(new char[new_block_size]);
+      block_sizes_.push_back(new_block_size);
+      offset_ = 0;
+    }
+
+    void* memory = blocks_[current_block_] + offset_;
+    offset_ += size;
+    bytes_allocated_ += size;
+    return memory;
+  }
+
+  void Arena::reset() {
+    current_block_ = 0;
+    offset_ = 0;
+    bytes_allocated_ = 0;
+  }
+
+  void Arena::swap(Arena& other) {
+    std::swap(block_size_, other.block_size_);
+    blocks_.swap(other.blocks_);
+    block_sizes_.swap(other.block_sizes_);
+    std::swap(current_block_, other.current_block_);
+    std::swap(offset_, other.offset_);
+    std::swap(bytes_allocated_, other.bytes_allocated_);
+  }
+
+  std::size_t Arena::getCapacity() const {
+    std::size_t capacity = 0;
+    for (std::size_t b = 0; b < block_sizes_.size(); ++b) {
+      capacity += block_sizes_[b];
+    }
+    return capacity;
+  }
+
+} /* bwi_guidance */
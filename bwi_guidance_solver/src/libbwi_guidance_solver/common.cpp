@@ -54,6 +54,14 @@ namespace bwi_guidance {
     }
   }
 
+  uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
   void dashedLine(cv::Mat& image, cv::Point start, cv::Point goal,
       cv::Scalar color, int dash_width, int thickness, int linetype) {
     cv::LineIterator it(image, start, goal, 8);   
@@ -1,39 +1,166 @@
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/serialization/map.hpp>
-#include <fstream> 
+#include <fstream>
+#include <sstream>
 
 #include <bwi_guidance_solver/person_estimator_qrr14.h>
 
 namespace bwi_guidance {
 
+  PersonEstimatorQRR14::PersonEstimatorQRR14(EstimatorMissPolicy miss_policy,
+      float default_value) : miss_policy_(miss_policy),
+  default_value_(default_value) {}
+
+  PersonEstimatorQRR14::PersonEstimatorQRR14(
+      const boost::shared_ptr<PersonModelQRR14>& model,
+      EstimatorMissPolicy miss_policy, float default_value) :
+    miss_policy_(miss_policy), default_value_(default_value), model_(model) {
+    unsigned int num_states = model_->getNumStates();
+    values_.assign(num_states, default_value_);
+    has_value_.assign(num_states, 0);
+    best_actions_.assign(num_states, ActionQRR14());
+    has_best_action_.assign(num_states, 0);
+  }
+
   float PersonEstimatorQRR14::getValue(const StateQRR14 &state) {
-    return value_cache_[state];
+    if (model_) {
+      int state_idx = model_->getStateIndex(state);
+      if (state_idx != -1) {
+        return getValueByIndex(state_idx);
+      }
+    } else {
+      std::map<StateQRR14, float>::const_iterator it =
+        value_cache_.find(state);
+      if (it != value_cache_.end()) {
+        return it->second;
+      }
+    }
+    if (miss_policy_ == MISS_THROW) {
+      throwMiss("value", state);
+    }
+    return default_value_;
   }
 
   void PersonEstimatorQRR14::updateValue(const StateQRR14 &state, float value) {
-    value_cache_[state] = value;
+    if (model_) {
+      int state_idx = model_->getStateIndex(state);
+      if (state_idx == -1) {
+        throwNotInStateSpace(state);
+      }
+      updateValueByIndex(state_idx, value);
+    } else {
+      value_cache_[state] = value;
+    }
   }
 
   ActionQRR14 PersonEstimatorQRR14::getBestAction(const StateQRR14 &state) {
-    return best_action_cache_[state];
+    if (model_) {
+      int state_idx = model_->getStateIndex(state);
+      if (state_idx != -1) {
+        return getBestActionByIndex(state_idx);
+      }
+    } else {
+      std::map<StateQRR14, ActionQRR14>::const_iterator it =
+        best_action_cache_.find(state);
+      if (it != best_action_cache_.end()) {
+        return it->second;
+      }
+    }
+    if (miss_policy_ == MISS_THROW) {
+      throwMiss("best action", state);
+    }
+    return ActionQRR14();
   }
 
-  void PersonEstimatorQRR14::setBestAction(const StateQRR14 &state, 
+  void PersonEstimatorQRR14::setBestAction(const StateQRR14 &state,
       const ActionQRR14& action) {
-    best_action_cache_[state] = action;
+    if (model_) {
+      int state_idx = model_->getStateIndex(state);
+      if (state_idx == -1) {
+        throwNotInStateSpace(state);
+      }
+      setBestActionByIndex(state_idx, action);
+    } else {
+      best_action_cache_[state] = action;
+    }
+  }
+
+  bool PersonEstimatorQRR14::hasBestAction(const StateQRR14 &state) const {
+    if (model_) {
+      int state_idx = model_->getStateIndex(state);
+      return state_idx != -1 && hasBestActionByIndex(state_idx);
+    }
+    return best_action_cache_.find(state) != best_action_cache_.end();
   }
 
   void PersonEstimatorQRR14::loadEstimatedValues(const std::string& file) {
     std::ifstream ifs(file.c_str());
     boost::archive::binary_iarchive ia(ifs);
     ia >> *this;
+
+    if (model_) {
+      // Move the loaded values into the arrays
+      values_.assign(values_.size(), default_value_);
+      has_value_.assign(has_value_.size(), 0);
+      has_best_action_.assign(has_best_action_.size(), 0);
+      for (std::map<StateQRR14, float>::const_iterator it =
+          value_cache_.begin(); it != value_cache_.end(); ++it) {
+        updateValue(it->first, it->second);
+      }
+      for (std::map<StateQRR14, ActionQRR14>::const_iterator it =
+          best_action_cache_.begin(); it != best_action_cache_.end(); ++it) {
+        setBestAction(it->first, it->second);
+      }
+      value_cache_.clear();
+      best_action_cache_.clear();
+    }
   }
 
   void PersonEstimatorQRR14::saveEstimatedValues(const std::string& file) {
+
+    if (model_) {
+      // The array backend is saved in the same format as the map backend
+      for (unsigned int state_idx = 0; state_idx < values_.size();
+          ++state_idx) {
+        const StateQRR14& state = model_->getState(state_idx);
+        if (has_value_[state_idx]) {
+          value_cache_[state] = values_[state_idx];
+        }
+        if (has_best_action_[state_idx]) {
+          best_action_cache_[state] = best_actions_[state_idx];
+        }
+      }
+    }
+
     std::ofstream ofs(file.c_str());
     boost::archive::binary_oarchive oa(ofs);
     oa << *this;
+
+    if (model_) {
+      value_cache_.clear();
+      best_action_cache_.clear();
+    }
+  }
+
+  void PersonEstimatorQRR14::throwMiss(const std::string& what,
+      int state_idx) const {
+    throwMiss(what, model_->getState(state_idx));
+  }
+
+  void PersonEstimatorQRR14::throwMiss(const std::string& what,
+      const StateQRR14& state) const {
+    std::stringstream ss;
+    ss << "PersonEstimatorQRR14: no " << what << " for state " << state;
+    throw std::out_of_range(ss.str());
+  }
+
+  void PersonEstimatorQRR14::throwNotInStateSpace(
+      const StateQRR14& state) const {
+    std::stringstream ss;
+    ss << "PersonEstimatorQRR14: state " << state << " is not in the state " <<
+      "space of the model";
+    throw std::out_of_range(ss.str());
   }
 
   template<class Archive>
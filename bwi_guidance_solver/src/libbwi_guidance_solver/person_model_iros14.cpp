@@ -36,6 +36,10 @@ namespace bwi_guidance {
     visibility_range /= map_.info.resolution;
 
     num_vertices_ = boost::num_vertices(graph_);
+    angle_table_ = GraphAngleTable(graph_);
+    motion_weights_ = MotionWeightTable(angle_table_, MOTION_SIGMA_SQ);
+    directed_motion_weights_ = 
+      MotionWeightTable(angle_table_, DIRECTED_MOTION_SIGMA_SQ);
     computeAdjacentVertices(adjacent_vertices_map_, graph_);
     computeVisibleVertices(visible_vertices_map_, graph_, map_, visibility_range);
 
@@ -118,7 +122,8 @@ namespace bwi_guidance {
       }
     }
     actions.push_back(ActionIROS14(WAIT, 0, 0));
-    std::vector<int> cant_assign_vertices = state.relieved_locations;
+    std::vector<int> cant_assign_vertices(state.relieved_locations.begin(),
+        state.relieved_locations.end());
     for (int i = 0; i < state.in_use_robots.size(); ++i) {
       if (std::find(state.acquired_locations.begin(),
             state.acquired_locations.end(),
@@ -539,9 +544,8 @@ namespace bwi_guidance {
       }
       assert(mark != -1);
       //current_state_.in_use_robots[mark].direction = action.guide_graph_id;
-      float direction = bwi_mapper::getNodeAngle(
-          current_state_.graph_id, action.guide_graph_id, graph_);
-      current_state_.direction = getDiscretizedAngle(direction);
+      current_state_.direction = angle_table_.getDirection(
+          current_state_.graph_id, action.guide_graph_id);
       current_state_.robot_gave_direction = true;
       current_state_.in_use_robots.erase(
           current_state_.in_use_robots.begin() + mark);
@@ -558,36 +562,58 @@ namespace bwi_guidance {
 
     // alright, need to wait for the human to take an action - let's first
     // figure out what action he takes
-    float expected_dir = getAngleInRadians(current_state_.direction);
     int robot_dir = 0;
-    if (isRobotDirectionAvailable(current_state_, robot_dir)) {
+    bool robot_dir_available = 
+      isRobotDirectionAvailable(current_state_, robot_dir);
+    if (robot_dir_available) {
       //assert(robot_dir != DIR_UNASSIGNED);
-      if (robot_dir != DIR_UNASSIGNED) {
-        expected_dir = bwi_mapper::getNodeAngle(
-          current_state_.graph_id, robot_dir, graph_);
-      } else {
+      if (robot_dir == DIR_UNASSIGNED) {
         std::cout << "oh no!" << std::endl;
         exit(-1);
       }
     }
 
-    double sigma_sq = 0.1;
-    if (current_state_.robot_gave_direction) {
-      sigma_sq = 0.05;
+    const MotionWeightTable& motion_weights = 
+      (current_state_.robot_gave_direction) ? 
+      directed_motion_weights_ : motion_weights_;
+    double sigma_sq = (current_state_.robot_gave_direction) ? 
+      DIRECTED_MOTION_SIGMA_SQ : MOTION_SIGMA_SQ;
+
+    // The weights are looked up from the precomputed table when the expected
+    // direction is a discretized direction, or the direction to an adjacent
+    // vertex
+    int u = current_state_.graph_id;
+    int robot_position = (robot_dir_available) ?
+      angle_table_.getAdjacentPosition(u, robot_dir) : -1;
+    bool tabulated = (robot_dir_available) ? (robot_position != -1) :
+      (current_state_.direction >= 0 && 
+       current_state_.direction < NUM_DIRECTIONS);
+    float expected_dir = 0.0f;
+    if (!tabulated) {
+      expected_dir = (robot_dir_available) ? 
+        angle_table_.getNodeAngle(u, robot_dir) :
+        getAngleInRadians(current_state_.direction);
     }
     
     // Now assume that the person moves to one the adjacent locations
     double weight_sum = 0;
     std::vector<double> weights;
-    BOOST_FOREACH(int adj, adjacent_vertices_map_[current_state_.graph_id]) {
-
-      float next_state_direction = bwi_mapper::getNodeAngle(
-          current_state_.graph_id, adj, graph_);
-      float angle_difference = getAbsoluteAngleDifference(next_state_direction, 
-          expected_dir);
+    const std::vector<int>& adjacent_vertices = 
+      angle_table_.getAdjacentVertices(u);
+    for (int i = 0; i < adjacent_vertices.size(); ++i) {
 
       // Compute the probability of this state
-      double weight = exp(-pow(angle_difference, 2) / (2 * sigma_sq));
+      double weight;
+      if (!tabulated) {
+        weight = getMotionWeight(
+            angle_table_.getNodeAngle(u, adjacent_vertices[i]), expected_dir,
+            sigma_sq);
+      } else if (robot_dir_available) {
+        weight = motion_weights.getWeightToAdjacent(u, i, robot_position);
+      } else {
+        weight = motion_weights.getWeightToDirection(u, i, 
+            current_state_.direction);
+      }
       weights.push_back(weight);
       weight_sum += weight;
     }
@@ -633,8 +659,8 @@ namespace bwi_guidance {
       shortest_distances_[current_state_.graph_id][goal_idx_] -
       shortest_distances_[next_node][goal_idx_];
 
-    current_state_.direction = computeNextDirection(
-        current_state_.direction, current_state_.graph_id, next_node, graph_);
+    current_state_.direction = 
+      angle_table_.getDirection(current_state_.graph_id, next_node);
     current_state_.robot_gave_direction = false;
     current_state_.precision = 0.0f;
     current_state_.from_graph_node = current_state_.graph_id;
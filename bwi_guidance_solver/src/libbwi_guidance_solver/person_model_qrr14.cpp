@@ -1,11 +1,14 @@
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
-
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
-#include <boost/serialization/map.hpp>
-#include <boost/serialization/vector.hpp>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
 
 #include <bwi_guidance_solver/person_model_qrr14.h>
 #include <bwi_mapper/point_utils.h>
@@ -13,17 +16,117 @@
 
 namespace bwi_guidance {
 
+  namespace {
+
+    const char MODEL_CACHE_MAGIC[8] = {'Q', 'R', 'R', '1', '4', 'M', 'D', 'L'};
+    const uint32_t MODEL_CACHE_VERSION = 1;
+
+    /* A model cache file contains the header, followed by a sequence of
+     * arrays (each prefixed by its size), and the checksum of the arrays */
+    struct ModelCacheHeader {
+      char magic[8];
+      uint32_t version;
+      uint32_t layout;
+      uint64_t key;
+      uint32_t goal_idx;
+      uint32_t num_vertices;
+    };
+
+    /* Changes if the in-memory layout of the cached structures changes */
+    const uint32_t MODEL_CACHE_LAYOUT = sizeof(StateQRR14) |
+      (sizeof(TransitionQRR14) << 8) | (NUM_DIRECTIONS << 16);
+
+    template <typename T>
+    void writeArray(std::ostream& out, const std::vector<T>& array,
+        uint64_t& checksum) {
+      uint64_t size = array.size();
+      out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      if (size != 0) {
+        out.write(reinterpret_cast<const char*>(&array[0]), 
+            size * sizeof(T));
+        checksum = hashBytes(&array[0], size * sizeof(T), checksum);
+      }
+    }
+
+    template <typename T>
+    bool readArray(std::istream& in, std::vector<T>& array, 
+        uint64_t max_size, uint64_t& checksum) {
+      uint64_t size;
+      if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)) ||
+          size > max_size / sizeof(T)) {
+        return false;
+      }
+      array.resize(size);
+      if (size != 0) {
+        if (!in.read(reinterpret_cast<char*>(&array[0]), size * sizeof(T))) {
+          return false;
+        }
+        checksum = hashBytes(&array[0], size * sizeof(T), checksum);
+      }
+      return true;
+    }
+
+    void flattenVertexMap(const std::map<int, std::vector<int> >& vertex_map,
+        int num_vertices, std::vector<int>& offsets, std::vector<int>& data) {
+      offsets.resize(num_vertices + 1);
+      data.clear();
+      for (int graph_id = 0; graph_id < num_vertices; ++graph_id) {
+        offsets[graph_id] = data.size();
+        std::map<int, std::vector<int> >::const_iterator it = 
+          vertex_map.find(graph_id);
+        if (it != vertex_map.end()) {
+          data.insert(data.end(), it->second.begin(), it->second.end());
+        }
+      }
+      offsets[num_vertices] = data.size();
+    }
+
+    bool unflattenVertexMap(const std::vector<int>& offsets, 
+        const std::vector<int>& data, int num_vertices,
+        std::map<int, std::vector<int> >& vertex_map) {
+      if (offsets.size() != num_vertices + 1 || 
+          offsets[num_vertices] != data.size()) {
+        return false;
+      }
+      vertex_map.clear();
+      for (int graph_id = 0; graph_id < num_vertices; ++graph_id) {
+        vertex_map[graph_id] = std::vector<int>(data.begin() + 
+            offsets[graph_id], data.begin() + offsets[graph_id + 1]);
+      }
+      return true;
+    }
+
+    /* Returns the time (in seconds) elapsed since start, and resets start */
+    float lapTime(boost::posix_time::ptime& start) {
+      boost::posix_time::ptime now = 
+        boost::posix_time::microsec_clock::local_time();
+      float elapsed = (now - start).total_microseconds() / 1e6f;
+      start = now;
+      return elapsed;
+    }
+
+  } /* anonymous namespace */
+
   PersonModelQRR14::PersonModelQRR14(const bwi_mapper::Graph& graph, const
       nav_msgs::OccupancyGrid& map,  size_t goal_idx, const std::string& file,
       bool allow_robot_current_idx, float visibility_range, bool
       allow_goal_visibility, unsigned int max_robots, float success_reward,
-      RewardStructure reward_structure, bool use_importance_sampling) : graph_(graph),
-  map_(map), goal_idx_(goal_idx),
+      RewardStructure reward_structure, bool use_importance_sampling,
+      unsigned int num_threads) : current_state_idx_(-1),
+  reward_structure_(reward_structure), success_reward_(success_reward),
+  use_importance_sampling_(use_importance_sampling),
+  structure_(new PersonModelStructureQRR14), max_robots_(max_robots),
+  num_threads_(num_threads), graph_(graph), map_(map), goal_idx_(goal_idx),
   allow_robot_current_idx_(allow_robot_current_idx),
-  visibility_range_(visibility_range),
-  allow_goal_visibility_(allow_goal_visibility), max_robots_(max_robots),
-  success_reward_(success_reward), reward_structure_(reward_structure),
-  use_importance_sampling_(use_importance_sampling) {
+  allow_goal_visibility_(allow_goal_visibility),
+  visibility_range_(visibility_range) {
+
+    if (num_threads_ == 0) {
+      num_threads_ = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    boost::posix_time::ptime phase_start = 
+      boost::posix_time::microsec_clock::local_time();
 
     // Initialize intrinsic reward cache
     for (size_t i = 0; i < boost::num_vertices(graph_); ++i) {
@@ -31,48 +134,95 @@ namespace bwi_guidance {
       intrinsic_reward_cache_.push_back(bwi_mapper::getShortestPathWithDistance(
             i, goal_idx_, temp_path, graph_));
     }
+    float shortest_path_time = lapTime(phase_start);
 
-    if (!file.empty()) {
-      std::ifstream ifs(file.c_str());
-      if (ifs.is_open()) {
-        std::cout << "PersonModel: Loading model from file: " << file <<
-          std::endl;
-        boost::archive::binary_iarchive ia(ifs);
-        ia >> *this;
-        std::cout << " - Model loaded from file!" << std::endl;
-        ifs.close();
-        return;
-      }
+    angle_table_.reset(new GraphAngleTable(graph_));
+    motion_weights_.reset(new MotionWeightTable(*angle_table_, 
+          MOTION_SIGMA_SQ));
+    float angle_time = lapTime(phase_start);
+
+    if (!file.empty() && loadModelCache(file)) {
+      std::cout << "PersonModel: Model loaded from file: " << file << 
+        std::endl;
+      std::cout << " - shortest paths: " << shortest_path_time << 
+        "s, angles: " << angle_time << "s, cache: " << lapTime(phase_start) << "s" << std::endl;
+      return;
     }
 
     // Compute Model
     initializeStateSpace();
+    float state_space_time = lapTime(phase_start);
+    initializeStateIndex();
+    float state_index_time = lapTime(phase_start);
     initializeActionCache();
+    float action_time = lapTime(phase_start);
     initializeNextStateCache();
+    float transition_time = lapTime(phase_start);
+    initializeRewardCache();
+    float reward_time = lapTime(phase_start);
 
     std::cout << "PersonModel: Model Computed!!" << std::endl;
+    std::cout << " - shortest paths: " << shortest_path_time << 
+      "s, angles: " << angle_time << 
+      "s, state space: " << state_space_time << 
+      "s, state index: " << state_index_time << 
+      "s, actions: " << action_time << 
+      "s, transitions: " << transition_time << "s (" << num_threads_ <<
+      " threads), rewards: " << reward_time << "s" << std::endl;
 
     if (!file.empty()) {
       std::cout << " - Saving to file: " << file <<
         std::endl;
-      std::ofstream ofs(file.c_str());
-      boost::archive::binary_oarchive oa(ofs);
-      oa << *this;
-      ofs.close();
+      saveModelCache(file);
     }
   }
 
+  PersonModelQRR14::PersonModelQRR14(const PersonModelQRR14& model, 
+      size_t goal_idx) : current_state_idx_(-1),
+  reward_structure_(model.reward_structure_),
+  success_reward_(model.success_reward_), 
+  use_importance_sampling_(model.use_importance_sampling_), 
+  angle_table_(model.angle_table_), motion_weights_(model.motion_weights_),
+  structure_(model.structure_),
+  transition_cache_(model.transition_cache_),
+  num_vertices_(model.num_vertices_), max_robots_(model.max_robots_),
+  num_threads_(model.num_threads_), graph_(model.graph_), 
+  goal_idx_(goal_idx),
+  allow_robot_current_idx_(model.allow_robot_current_idx_),
+  allow_goal_visibility_(model.allow_goal_visibility_), 
+  visibility_range_(model.visibility_range_) {
+
+    // The map is only required while computing the state space, and is not
+    // copied.
+
+    // Initialize intrinsic reward cache
+    for (size_t i = 0; i < boost::num_vertices(graph_); ++i) {
+      std::vector<size_t> temp_path;
+      intrinsic_reward_cache_.push_back(bwi_mapper::getShortestPathWithDistance(
+            i, goal_idx_, temp_path, graph_));
+    }
+
+    initializeGoalTransitions(model.goal_idx_);
+    initializeRewardCache();
+  }
+
   bool PersonModelQRR14::isTerminalState(const StateQRR14& state) const {
     return state.graph_id == goal_idx_;
   }
 
   void PersonModelQRR14::getStateVector(std::vector<StateQRR14>& states) {
-    states = state_cache_;
+    states = structure_->state_cache;
   }
 
   void PersonModelQRR14::getActionsAtState(const StateQRR14& state, 
       std::vector<ActionQRR14>& actions) {
-    actions = action_cache_[state];
+    int state_idx = getStateIndex(state);
+    if (state_idx == -1) {
+      actions.clear();
+      return;
+    }
+    actions.assign(structure_->action_cache.begin() + structure_->action_offset[state_idx],
+        structure_->action_cache.begin() + structure_->action_offset[state_idx + 1]);
   }
 
   /** Get the predictions of the MDP model for a given state action */
@@ -88,41 +238,23 @@ namespace bwi_guidance {
       return; // no next states for you!
     }
 
-    getNextStates(state, action, next_states); // copy cost
-    probabilities = getTransitionProbabilities(state, action);
-
-    rewards.resize(next_states.size());
-    // Compute reward based on euclidean distance between state graph ids
-    for (std::vector<StateQRR14>::const_iterator ns = next_states.begin();
-        ns != next_states.end(); ++ns) {
-
-      rewards[ns - next_states.begin()] = 0;
-
-      // Add shaping reward as necessary
-      if (reward_structure_ == INTRINSIC_REWARD ||
-          reward_structure_ == SHAPING_REWARD) {
-        rewards[ns - next_states.begin()] +=
-          intrinsic_reward_cache_[state.graph_id] - 
-          intrinsic_reward_cache_[ns->graph_id];
-      }
-
-      if (reward_structure_ == STANDARD_REWARD ||
-          reward_structure_ == SHAPING_REWARD) {
-        // Standard reward formulation
-        rewards[ns - next_states.begin()] +=
-          -bwi_mapper::getEuclideanDistance(state.graph_id, ns->graph_id,
-              graph_);
-      }
-
-      if (isTerminalState(*ns)) {
-        rewards[ns - next_states.begin()] += success_reward_;
-      }
+    int action_idx = getActionIndex(getStateIndex(state), action);
+    if (action_idx == -1) {
+      return; // action not available at this state
+    }
 
+    const TransitionQRR14* transitions_end = getTransitionsEnd(action_idx);
+    for (const TransitionQRR14* transition = getTransitionsBegin(action_idx);
+        transition != transitions_end; ++transition) {
+      next_states.push_back(structure_->state_cache[transition->next_state_idx]);
+      rewards.push_back(transition->reward);
+      probabilities.push_back(transition->probability);
     }
   }
 
   void PersonModelQRR14::setState(const StateQRR14 &state) {
     current_state_ = state;
+    current_state_idx_ = getStateIndex(state);
   }
 
   void PersonModelQRR14::takeAction(const ActionQRR14 &action, float &reward, 
@@ -136,11 +268,12 @@ namespace bwi_guidance {
       throw std::runtime_error("Cannot call takeAction() on terminal state");
     }
 
-    std::vector<StateQRR14> next_states;
-    std::vector<float> probabilities;
-    std::vector<float> rewards;
-    getTransitionDynamics(current_state_, action, 
-        next_states, rewards, probabilities);
+    int action_idx = getActionIndex(current_state_idx_, action);
+    if (action_idx == -1) {
+      throw std::runtime_error("Action not available at current state");
+    }
+    const TransitionQRR14* transitions = getTransitionsBegin(action_idx);
+    int num_transitions = getTransitionsEnd(action_idx) - transitions;
 
     // Modify probability distribution to improve occurence of rare events
     // if (use_importance_sampling_) {
@@ -154,9 +287,21 @@ namespace bwi_guidance {
     //   }
     // }
 
-    int idx = select(probabilities, generator_);
-    current_state_ = next_states[idx];
-    reward = rewards[idx];
+    // Same sampling scheme as select() in utils.h, walking the row in place
+    int idx = num_transitions - 1;
+    float random_value = (*generator_)();
+    float probability_sum = transitions[0].probability;
+    for (int i = 1; i < num_transitions; ++i) {
+      if (random_value < probability_sum) {
+        idx = i - 1;
+        break;
+      }
+      probability_sum += transitions[i].probability;
+    }
+
+    current_state_idx_ = transitions[idx].next_state_idx;
+    current_state_ = structure_->state_cache[current_state_idx_];
+    reward = transitions[idx].reward;
     state = current_state_;
     terminal = isTerminalState(current_state_);
     depth_count = 1;
@@ -164,31 +309,36 @@ namespace bwi_guidance {
 
   void PersonModelQRR14::getFirstAction(const StateQRR14 &state, 
       ActionQRR14 &action) {
-    std::vector<ActionQRR14>& actions = getActionsAtState(state);
-    action = actions[0];
+    int state_idx = getStateIndex(state);
+    action = structure_->action_cache[structure_->action_offset[state_idx]];
   }
 
   bool PersonModelQRR14::getNextAction(const StateQRR14 &state, 
       ActionQRR14 &action) {
-    std::vector<ActionQRR14>& actions = getActionsAtState(state);
-    for (size_t i = 0; i < actions.size() - 1; ++i) {
-      if (actions[i] == action) {
-        action = actions[i + 1];
-        return true;
-      }
+    int state_idx = getStateIndex(state);
+    int action_idx = getActionIndex(state_idx, action);
+    if (action_idx == -1 || action_idx + 1 >= structure_->action_offset[state_idx + 1]) {
+      return false;
     }
-    return false;
+    action = structure_->action_cache[action_idx + 1];
+    return true;
   }
   
   float PersonModelQRR14::getTransitionProbability(const StateQRR14& state,
       const ActionQRR14& action, const StateQRR14& next_state) {
-    std::vector<float>& probabilities = 
-      getTransitionProbabilities(state, action);
-    std::vector<StateQRR14> next_states;
-    getNextStates(state, action, next_states);
-    for (unsigned int i = 0; i < next_states.size(); ++i) {
-      if (next_states[i] == next_state)
-        return probabilities[i];
+    if (isTerminalState(state)) {
+      return 0;
+    }
+    int action_idx = getActionIndex(getStateIndex(state), action);
+    int next_state_idx = getStateIndex(next_state);
+    if (action_idx == -1 || next_state_idx == -1) {
+      return 0;
+    }
+    const TransitionQRR14* transitions_end = getTransitionsEnd(action_idx);
+    for (const TransitionQRR14* transition = getTransitionsBegin(action_idx);
+        transition != transitions_end; ++transition) {
+      if (transition->next_state_idx == next_state_idx)
+        return transition->probability;
     }
     return 0;
   }
@@ -199,23 +349,28 @@ namespace bwi_guidance {
 
   void PersonModelQRR14::updateRewardStructure(float success_reward, 
       RewardStructure reward_structure, bool use_importance_sampling) {
+    bool rewards_changed = success_reward_ != success_reward ||
+      reward_structure_ != reward_structure;
     success_reward_ = success_reward;
     reward_structure_ = reward_structure;
     use_importance_sampling_ = use_importance_sampling;
+    if (rewards_changed) {
+      initializeRewardCache();
+    }
   }
 
   void PersonModelQRR14::initializeStateSpace() {
 
     num_vertices_ = boost::num_vertices(graph_);
 
-    computeAdjacentVertices(adjacent_vertices_map_, graph_);
-    computeVisibleVertices(visible_vertices_map_, graph_, map_,
+    computeAdjacentVertices(structure_->adjacent_vertices_map, graph_);
+    computeVisibleVertices(structure_->visible_vertices_map, graph_, map_,
         visibility_range_);
 
-    state_cache_.clear();
+    structure_->state_cache.clear();
     for (int graph_id = 0; graph_id < num_vertices_; ++graph_id) {
-      std::vector<int>& adjacent_vertices = adjacent_vertices_map_[graph_id];
-      std::vector<int>& visible_vertices = visible_vertices_map_[graph_id];
+      std::vector<int>& adjacent_vertices = structure_->adjacent_vertices_map[graph_id];
+      std::vector<int>& visible_vertices = structure_->visible_vertices_map[graph_id];
       for (int direction = 0; direction < NUM_DIRECTIONS; ++direction) {
         for (int robots = 0; robots <= max_robots_; ++robots) {
 
@@ -228,7 +383,7 @@ namespace bwi_guidance {
           if (robots == max_robots_) {
             state.robot_direction = NONE;
             state.visible_robot = NONE;
-            state_cache_.push_back(state);
+            structure_->state_cache.push_back(state);
             continue;
           }
 
@@ -252,7 +407,7 @@ namespace bwi_guidance {
               } else { // resolve to visible node
                 state.visible_robot = visible_vertices[vr];
               }
-              state_cache_.push_back(state);
+              structure_->state_cache.push_back(state);
             }
           }
         }
@@ -260,12 +415,129 @@ namespace bwi_guidance {
     }
   }
 
+  void PersonModelQRR14::initializeStateIndex() {
+
+    structure_->vertex_state_offset.resize(num_vertices_ + 1);
+    structure_->vertex_robots_block_size.resize(num_vertices_);
+    structure_->vertex_visible_block_size.resize(num_vertices_);
+    structure_->adjacent_position.assign(num_vertices_ * num_vertices_, -1);
+    structure_->visible_position.assign(num_vertices_ * num_vertices_, -1);
+
+    // This needs to mirror the loops in initializeStateSpace() exactly
+    int offset = 0;
+    for (int graph_id = 0; graph_id < num_vertices_; ++graph_id) {
+      std::vector<int>& adjacent_vertices = structure_->adjacent_vertices_map[graph_id];
+      std::vector<int>& visible_vertices = structure_->visible_vertices_map[graph_id];
+
+      int* adjacent_position = &structure_->adjacent_position[graph_id * num_vertices_];
+      for (int rd = 0; rd < adjacent_vertices.size(); ++rd) {
+        // 0 and 1 are used by DIR_UNASSIGNED and NONE
+        adjacent_position[adjacent_vertices[rd]] = rd + 2;
+      }
+
+      int* visible_position = &structure_->visible_position[graph_id * num_vertices_];
+      int num_visible = 1; // NONE
+      for (int vr = 0; vr < visible_vertices.size(); ++vr) {
+        if (visible_vertices[vr] == graph_id) {
+          continue;
+        }
+        visible_position[visible_vertices[vr]] = num_visible;
+        ++num_visible;
+      }
+
+      structure_->vertex_visible_block_size[graph_id] = num_visible;
+      structure_->vertex_robots_block_size[graph_id] = 
+        (adjacent_vertices.size() + 2) * num_visible;
+      structure_->vertex_state_offset[graph_id] = offset;
+      offset += NUM_DIRECTIONS * 
+        (max_robots_ * structure_->vertex_robots_block_size[graph_id] + 1);
+    }
+    structure_->vertex_state_offset[num_vertices_] = offset;
+
+    if (offset != structure_->state_cache.size()) {
+      throw std::runtime_error("PersonModelQRR14: state index does not match "
+          "the state space. Was the model file generated with different "
+          "parameters?");
+    }
+
+    uint32_t checksum = 2166136261u;
+    BOOST_FOREACH(const StateQRR14& state, structure_->state_cache) {
+      int32_t fields[5] = { state.graph_id, state.direction, 
+        state.num_robots_left, state.robot_direction, state.visible_robot };
+      const unsigned char* bytes = 
+        reinterpret_cast<const unsigned char*>(fields);
+      for (size_t i = 0; i < sizeof(fields); ++i) {
+        checksum = (checksum ^ bytes[i]) * 16777619u;
+      }
+    }
+    structure_->state_space_checksum = checksum;
+  }
+
+  int PersonModelQRR14::getStateIndex(const StateQRR14& state) const {
+
+    if (state.graph_id < 0 || state.graph_id >= (int)num_vertices_ ||
+        state.direction < 0 || state.direction >= (int)NUM_DIRECTIONS ||
+        state.num_robots_left < 0 || 
+        state.num_robots_left > (int)max_robots_) {
+      return -1;
+    }
+
+    int robots_block_size = structure_->vertex_robots_block_size[state.graph_id];
+    int idx = structure_->vertex_state_offset[state.graph_id] + 
+      state.direction * (max_robots_ * robots_block_size + 1);
+
+    // If all robots are available, no other robots can have been placed
+    if (state.num_robots_left == max_robots_) {
+      if (state.robot_direction != NONE || state.visible_robot != NONE) {
+        return -1;
+      }
+      return idx + max_robots_ * robots_block_size;
+    }
+
+    int rd_position;
+    if (state.robot_direction == DIR_UNASSIGNED) {
+      rd_position = 0;
+    } else if (state.robot_direction == NONE) {
+      rd_position = 1;
+    } else if (state.robot_direction >= 0 && 
+        state.robot_direction < (int)num_vertices_) {
+      rd_position = structure_->adjacent_position[state.graph_id * num_vertices_ +
+        state.robot_direction];
+    } else {
+      return -1;
+    }
+
+    int vr_position;
+    if (state.visible_robot == NONE) {
+      vr_position = 0;
+    } else if (state.visible_robot >= 0 && 
+        state.visible_robot < (int)num_vertices_) {
+      vr_position = structure_->visible_position[state.graph_id * num_vertices_ +
+        state.visible_robot];
+    } else {
+      return -1;
+    }
+
+    if (rd_position == -1 || vr_position == -1) {
+      return -1;
+    }
+
+    return idx + state.num_robots_left * robots_block_size + 
+      rd_position * structure_->vertex_visible_block_size[state.graph_id] + vr_position;
+  }
+
   void PersonModelQRR14::initializeActionCache() {
-    action_cache_.clear();
-    for (std::vector<StateQRR14>::iterator it = state_cache_.begin(); 
-        it != state_cache_.end(); ++it) {
-      constructActionsAtState(*it, action_cache_[*it]);
+    structure_->action_cache.clear();
+    structure_->action_offset.resize(structure_->state_cache.size() + 1);
+    std::vector<ActionQRR14> actions;
+    for (unsigned int state_idx = 0; state_idx < structure_->state_cache.size(); 
+        ++state_idx) {
+      structure_->action_offset[state_idx] = structure_->action_cache.size();
+      constructActionsAtState(structure_->state_cache[state_idx], actions);
+      structure_->action_cache.insert(structure_->action_cache.end(), actions.begin(), 
+          actions.end());
     }
+    structure_->action_offset[structure_->state_cache.size()] = structure_->action_cache.size();
   }
 
   void PersonModelQRR14::constructActionsAtState(const StateQRR14& state, 
@@ -276,7 +548,7 @@ namespace bwi_guidance {
     // If a direction has to be assigned in the current state, only one of many
     // DIRECT_PERSON actions can be taken
     if (state.robot_direction == DIR_UNASSIGNED) {
-      BOOST_FOREACH(int id, adjacent_vertices_map_[state.graph_id]) {
+      BOOST_FOREACH(int id, structure_->adjacent_vertices_map[state.graph_id]) {
         actions.push_back(ActionQRR14(DIRECT_PERSON, id));
       }
       return;
@@ -287,7 +559,7 @@ namespace bwi_guidance {
 
     // Check if the system can place robots
     if (state.num_robots_left != 0) {
-      BOOST_FOREACH(int id, visible_vertices_map_[state.graph_id]) {
+      BOOST_FOREACH(int id, structure_->visible_vertices_map[state.graph_id]) {
         if (state.graph_id != id) {
           if (state.visible_robot == NONE) {
             actions.push_back(ActionQRR14(PLACE_ROBOT, id)); 
@@ -302,37 +574,229 @@ namespace bwi_guidance {
 
   }
 
-  std::vector<ActionQRR14>& PersonModelQRR14::getActionsAtState(
-      const StateQRR14& state) {
-    return action_cache_[state];
+  int PersonModelQRR14::getActionIndex(int state_idx, 
+      const ActionQRR14& action) const {
+    if (state_idx == -1) {
+      return -1;
+    }
+    for (unsigned int action_idx = structure_->action_offset[state_idx]; 
+        action_idx < structure_->action_offset[state_idx + 1]; ++action_idx) {
+      if (structure_->action_cache[action_idx] == action) {
+        return action_idx;
+      }
+    }
+    return -1;
   }
 
   void PersonModelQRR14::initializeNextStateCache() {
 
-    ns_distribution_cache_.clear();
-    BOOST_FOREACH(const StateQRR14& state, state_cache_) {
-      std::vector<ActionQRR14>& actions = getActionsAtState(state);
-      BOOST_FOREACH(const ActionQRR14& action, actions) {
-        constructTransitionProbabilities(state, action, 
-            ns_distribution_cache_[state][action]);
+    unsigned int num_states = structure_->state_cache.size();
+    structure_->transition_offset.resize(structure_->action_cache.size() + 1);
+
+    // The vertex maps are looked up with operator[] while constructing
+    // transitions. Make sure every vertex is present, so that the lookups
+    // never insert while the worker threads are reading the maps.
+    for (int graph_id = 0; graph_id < num_vertices_; ++graph_id) {
+      structure_->adjacent_vertices_map[graph_id];
+      structure_->visible_vertices_map[graph_id];
+    }
+
+    // Each thread computes the transitions for a contiguous block of states
+    // into its own buffer, with transition offsets relative to the start of
+    // that buffer. The buffers are then concatenated in order, so the table
+    // is identical to the one computed by a single thread.
+    unsigned int num_threads = std::min(num_threads_, 
+        std::max(1u, num_states));
+    std::vector<unsigned int> block_start(num_threads + 1);
+    for (unsigned int t = 0; t <= num_threads; ++t) {
+      block_start[t] = ((unsigned long)num_states * t) / num_threads;
+    }
+    std::vector<std::vector<TransitionQRR14> > block_transitions(num_threads);
+    std::vector<std::string> block_errors(num_threads);
+
+    if (num_threads == 1) {
+      constructTransitionBlock(0, num_states, block_transitions[0],
+          block_errors[0]);
+    } else {
+      boost::thread_group threads;
+      for (unsigned int t = 0; t < num_threads; ++t) {
+        threads.create_thread(boost::bind(
+              &PersonModelQRR14::constructTransitionBlock, this, 
+              block_start[t], block_start[t + 1], 
+              boost::ref(block_transitions[t]), boost::ref(block_errors[t])));
+      }
+      threads.join_all();
+    }
+
+    BOOST_FOREACH(const std::string& error, block_errors) {
+      if (!error.empty()) {
+        throw std::runtime_error(error);
+      }
+    }
+
+    // Merge the per thread buffers into the transition table
+    size_t num_transitions = 0;
+    BOOST_FOREACH(const std::vector<TransitionQRR14>& transitions,
+        block_transitions) {
+      num_transitions += transitions.size();
+    }
+    transition_cache_.clear();
+    transition_cache_.reserve(num_transitions);
+    for (unsigned int t = 0; t < num_threads; ++t) {
+      unsigned int base = transition_cache_.size();
+      for (unsigned int action_idx = 
+          structure_->action_offset[block_start[t]];
+          action_idx < structure_->action_offset[block_start[t + 1]];
+          ++action_idx) {
+        structure_->transition_offset[action_idx] += base;
+      }
+      transition_cache_.insert(transition_cache_.end(),
+          block_transitions[t].begin(), block_transitions[t].end());
+      std::vector<TransitionQRR14>().swap(block_transitions[t]);
+    }
+    structure_->transition_offset[structure_->action_cache.size()] = transition_cache_.size();
+
+  }
+
+  void PersonModelQRR14::constructTransitionBlock(unsigned int start_idx,
+      unsigned int end_idx, std::vector<TransitionQRR14>& transitions,
+      std::string& error) {
+
+    try {
+      std::vector<StateQRR14> next_states;
+      std::vector<float> probabilities;
+      for (unsigned int state_idx = start_idx; state_idx < end_idx; 
+          ++state_idx) {
+        const StateQRR14& state = structure_->state_cache[state_idx];
+        for (unsigned int action_idx = structure_->action_offset[state_idx];
+            action_idx < structure_->action_offset[state_idx + 1]; 
+            ++action_idx) {
+          const ActionQRR14& action = structure_->action_cache[action_idx];
+          structure_->transition_offset[action_idx] = transitions.size();
+          constructNextStates(state, action, next_states);
+          constructTransitionProbabilities(state, action, probabilities);
+          for (unsigned int ns = 0; ns < next_states.size(); ++ns) {
+            TransitionQRR14 transition;
+            transition.next_state_idx = getStateIndex(next_states[ns]);
+            if (transition.next_state_idx == -1) {
+              throw std::runtime_error("PersonModelQRR14: next state outside "
+                  "the state space!!!");
+            }
+            transition.probability = probabilities[ns];
+            transition.reward = 0.0f; // see initializeRewardCache()
+            transitions.push_back(transition);
+          }
+        }
       }
+    } catch (const std::exception& e) {
+      // Rethrown from initializeNextStateCache() once all threads are done
+      error = e.what();
+    }
+  }
+
+  void PersonModelQRR14::initializeGoalTransitions(size_t previous_goal_idx) {
+
+    // Transition probabilities only depend on the goal if it can be seen
+    if (!allow_goal_visibility_ || previous_goal_idx == goal_idx_) {
+      return;
     }
 
+    std::vector<float> probabilities;
+    for (int graph_id = 0; graph_id < num_vertices_; ++graph_id) {
+      std::vector<int>& visible_vertices = 
+        structure_->visible_vertices_map[graph_id];
+      bool affected = 
+        std::find(visible_vertices.begin(), visible_vertices.end(), 
+            goal_idx_) != visible_vertices.end() ||
+        std::find(visible_vertices.begin(), visible_vertices.end(), 
+            previous_goal_idx) != visible_vertices.end();
+      if (!affected) {
+        continue;
+      }
+      for (int state_idx = structure_->vertex_state_offset[graph_id];
+          state_idx < structure_->vertex_state_offset[graph_id + 1];
+          ++state_idx) {
+        const StateQRR14& state = structure_->state_cache[state_idx];
+        for (unsigned int action_idx = structure_->action_offset[state_idx];
+            action_idx < structure_->action_offset[state_idx + 1]; 
+            ++action_idx) {
+          const ActionQRR14& action = structure_->action_cache[action_idx];
+          if (action.type != DO_NOTHING) {
+            continue;
+          }
+          constructTransitionProbabilities(state, action, probabilities);
+          TransitionQRR14* transitions = &transition_cache_[0] + 
+            structure_->transition_offset[action_idx];
+          for (unsigned int ns = 0; ns < probabilities.size(); ++ns) {
+            transitions[ns].probability = probabilities[ns];
+          }
+        }
+      }
+    }
+  }
+
+  void PersonModelQRR14::initializeRewardCache() {
+    for (unsigned int state_idx = 0; state_idx < structure_->state_cache.size(); 
+        ++state_idx) {
+      const StateQRR14& state = structure_->state_cache[state_idx];
+      TransitionQRR14* transitions_begin = 
+        &transition_cache_[0] + structure_->transition_offset[structure_->action_offset[state_idx]];
+      TransitionQRR14* transitions_end = 
+        &transition_cache_[0] + structure_->transition_offset[structure_->action_offset[state_idx + 1]];
+      for (TransitionQRR14* transition = transitions_begin; 
+          transition != transitions_end; ++transition) {
+
+        const StateQRR14& next_state = 
+          structure_->state_cache[transition->next_state_idx];
+        transition->reward = 0;
+
+        // Add shaping reward as necessary
+        if (reward_structure_ == INTRINSIC_REWARD ||
+            reward_structure_ == SHAPING_REWARD) {
+          transition->reward +=
+            intrinsic_reward_cache_[state.graph_id] - 
+            intrinsic_reward_cache_[next_state.graph_id];
+        }
+
+        // Compute reward based on euclidean distance between state graph ids
+        if (reward_structure_ == STANDARD_REWARD ||
+            reward_structure_ == SHAPING_REWARD) {
+          // Standard reward formulation
+          transition->reward +=
+            -bwi_mapper::getEuclideanDistance(state.graph_id, 
+                next_state.graph_id, graph_);
+        }
+
+        if (isTerminalState(next_state)) {
+          transition->reward += success_reward_;
+        }
+      }
+    }
   }
 
   void PersonModelQRR14::getNextStates(const StateQRR14& state, const ActionQRR14& action, 
       std::vector<StateQRR14>& next_states) {
 
-    next_states.clear();
-
     // getNextStates does not check if this action was indeed allowed at the
     // given state. With an incorrect action, this function will probably lead
     // you to a non existent state.
 
     if (isTerminalState(state)) {
+      next_states.clear();
       return; // no next states
     }
 
+    constructNextStates(state, action, next_states);
+  }
+
+  void PersonModelQRR14::constructNextStates(const StateQRR14& state, 
+      const ActionQRR14& action, std::vector<StateQRR14>& next_states) {
+
+    // Unlike getNextStates(), this also computes the transitions out of the
+    // goal, so that the transition table layout does not depend on the goal
+
+    next_states.clear();
+
     // First figure out next states for all actions that will end up in a
     // deterministic state transition
     if (action.type == PLACE_ROBOT) {
@@ -363,7 +827,7 @@ namespace bwi_guidance {
    
     // Get all adjacent ids the person can transition to
     // Algorithm 1 in paper
-    BOOST_FOREACH(int next_node, adjacent_vertices_map_[state.graph_id]) {
+    BOOST_FOREACH(int next_node, structure_->adjacent_vertices_map[state.graph_id]) {
       StateQRR14 next_state;
       if (state.visible_robot == NONE) {
         // If no robot was visible in previous state, no robot can be present
@@ -374,9 +838,9 @@ namespace bwi_guidance {
           // We moved up to a robot, setup a robot here without an assigned dir
           next_state.robot_direction = DIR_UNASSIGNED;
           next_state.visible_robot = NONE; // no longer tracked 
-        } else if (std::find(visible_vertices_map_[next_node].begin(),
-              visible_vertices_map_[next_node].end(), state.visible_robot) ==
-            visible_vertices_map_[next_node].end()) { 
+        } else if (std::find(structure_->visible_vertices_map[next_node].begin(),
+              structure_->visible_vertices_map[next_node].end(), state.visible_robot) ==
+            structure_->visible_vertices_map[next_node].end()) { 
           // The person moved such that a previously visible robot is no 
           // longer visible. Decomission the robot.
           next_state.robot_direction = NONE;
@@ -388,8 +852,8 @@ namespace bwi_guidance {
         }
       }
     
-      next_state.direction = computeNextDirection(state.direction,
-          state.graph_id, next_node, graph_);
+      next_state.direction = 
+        angle_table_->getDirection(state.graph_id, next_node);
       next_state.num_robots_left = state.num_robots_left;
       next_state.graph_id = next_node;
       next_states.push_back(next_state);
@@ -405,10 +869,6 @@ namespace bwi_guidance {
     // indeed allowed at the given state. With an incorrect action, this
     // function will probably lead you to a non existent state.
 
-    if (isTerminalState(state)) {
-      return; // since next_states.size == 0
-    }
-
     if (action.type == DIRECT_PERSON || action.type == PLACE_ROBOT) {
       probabilities.push_back(1.0f); //since next_states.size == 1
       return;
@@ -429,7 +889,7 @@ namespace bwi_guidance {
     // the next robot and moving towards it.
 
     std::vector<int>& visible_vertices = 
-      visible_vertices_map_[state.graph_id];
+      structure_->visible_vertices_map[state.graph_id];
     bool goal_visible = allow_goal_visibility_ &&
       std::find(visible_vertices.begin(), visible_vertices.end(), goal_idx_) !=
       visible_vertices.end();
@@ -437,22 +897,21 @@ namespace bwi_guidance {
     if (state.visible_robot != NONE || goal_visible) {
       int target = (goal_visible) ? goal_idx_ : state.visible_robot;
       // Check angle to target
-      float expected_dir = 
-        bwi_mapper::getNodeAngle(state.graph_id, target, graph_);
+      float expected_dir = angle_table_->getNodeAngle(state.graph_id, target);
       float angle_diff = getAbsoluteAngleDifference(expected_dir, 
-          getAngleInRadians(state.direction));
+          angle_table_->getDirectionAngle(state.direction));
       if (angle_diff < M_PI / 3) {
         // target is inside visibility cone, so we are pretty sure it has been
         // seen. case 1 is finally true!
         case_1_invalid = false;
 
         std::vector<StateQRR14> next_states;
-        getNextStates(state, action, next_states);
+        constructNextStates(state, action, next_states);
 
         std::vector<float> differences;
         BOOST_FOREACH(const StateQRR14& next_state, next_states) {
-          float ns_angle = bwi_mapper::getNodeAngle(state.graph_id,
-              next_state.graph_id, graph_);
+          float ns_angle = angle_table_->getNodeAngle(state.graph_id,
+              next_state.graph_id);
           float ns_difference = getAbsoluteAngleDifference(expected_dir,
               ns_angle);
           differences.push_back(ns_difference);
@@ -487,35 +946,34 @@ namespace bwi_guidance {
     }
 
     /* Case 2 and 3 */
-    float expected_dir;
+    int robot_position = -1;
     if (state.robot_direction != NONE) {
       // Case 2
       if (state.robot_direction == DIR_UNASSIGNED) {
         // The DO_NOTHING action should not be possible in this state
         throw std::runtime_error("Human Model: unassigned robot_dir!!!");
       }
-      expected_dir = bwi_mapper::getNodeAngle(state.graph_id,
-          state.robot_direction, graph_);
-    } else {
-      expected_dir = getAngleInRadians(state.direction);
+      robot_position = angle_table_->getAdjacentPosition(state.graph_id,
+          state.robot_direction);
+      if (robot_position == -1) {
+        throw std::runtime_error("Human Model: robot_dir is not adjacent!!!");
+      }
     }
 
     // Now compute the weight of each next state. Get the favored direction
-    // and compute transition probabilities
+    // and compute transition probabilities. The next states are in the order
+    // of the adjacent vertices, which is the order of the weight table.
     std::vector<StateQRR14> next_states;
-    getNextStates(state, action, next_states);
+    constructNextStates(state, action, next_states);
 
     float weight_sum = 0;
     std::vector<float> weights;
-    BOOST_FOREACH(const StateQRR14& next_state, next_states) {
-
-      float next_state_direction = bwi_mapper::getNodeAngle(
-          state.graph_id, next_state.graph_id, graph_);
-      float angle_difference = getAbsoluteAngleDifference(next_state_direction, 
-          expected_dir);
-
-      // Compute the probability of this state
-      float weight = exp(-pow(angle_difference, 2) / (2 * 0.1));
+    for (int i = 0; i < next_states.size(); ++i) {
+      float weight = (robot_position != -1) ?
+        motion_weights_->getWeightToAdjacent(state.graph_id, i, 
+            robot_position) :
+        motion_weights_->getWeightToDirection(state.graph_id, i, 
+            state.direction);
       weights.push_back(weight);
       weight_sum += weight;
     }
@@ -535,9 +993,186 @@ namespace bwi_guidance {
     }
   }
 
-  std::vector<float>& PersonModelQRR14::getTransitionProbabilities(
-      const StateQRR14& state, const ActionQRR14& action) {
-    return ns_distribution_cache_[state][action];
+  uint64_t PersonModelQRR14::computeCacheKey() const {
+
+    uint64_t key = hashBytes(&MODEL_CACHE_VERSION, sizeof(uint32_t));
+
+    // Graph
+    for (size_t graph_id = 0; graph_id < boost::num_vertices(graph_); 
+        ++graph_id) {
+      bwi_mapper::Point2f location = 
+        bwi_mapper::getLocationFromGraphId(graph_id, graph_);
+      float coordinates[2] = { location.x, location.y };
+      key = hashBytes(coordinates, sizeof(coordinates), key);
+      std::vector<size_t> adjacent_vertices;
+      bwi_mapper::getAdjacentNodes(graph_id, graph_, adjacent_vertices);
+      BOOST_FOREACH(size_t adjacent_vertex, adjacent_vertices) {
+        uint32_t vertex = adjacent_vertex;
+        key = hashBytes(&vertex, sizeof(vertex), key);
+      }
+    }
+
+    // Map (affects visibility)
+    double map_info[5] = { map_.info.resolution, map_.info.width, 
+      map_.info.height, map_.info.origin.position.x, 
+      map_.info.origin.position.y };
+    key = hashBytes(map_info, sizeof(map_info), key);
+    if (!map_.data.empty()) {
+      key = hashBytes(&map_.data[0], map_.data.size(), key);
+    }
+
+    // Parameters
+    uint32_t max_robots = max_robots_;
+    uint8_t flags[2] = { allow_robot_current_idx_, allow_goal_visibility_ };
+    key = hashBytes(&max_robots, sizeof(max_robots), key);
+    key = hashBytes(&visibility_range_, sizeof(visibility_range_), key);
+    key = hashBytes(flags, sizeof(flags), key);
+
+    return key;
+  }
+
+  bool PersonModelQRR14::loadModelCache(const std::string& file) {
+
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.is_open()) {
+      return false;
+    }
+    ifs.seekg(0, std::ios::end);
+    uint64_t file_size = ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+
+    ModelCacheHeader header;
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic)) ||
+        header.version != MODEL_CACHE_VERSION ||
+        header.layout != MODEL_CACHE_LAYOUT) {
+      std::cout << "PersonModel: Ignoring model cache " << file << 
+        " (incompatible format)" << std::endl;
+      return false;
+    }
+    if (header.key != computeCacheKey() || 
+        header.num_vertices != boost::num_vertices(graph_) ||
+        header.goal_idx >= header.num_vertices) {
+      std::cout << "PersonModel: Ignoring model cache " << file << 
+        " (computed with a different graph, map or parameters)" << std::endl;
+      return false;
+    }
+
+    uint64_t checksum = FNV_OFFSET_BASIS;
+    std::vector<int> adjacent_offsets, adjacent_data;
+    std::vector<int> visible_offsets, visible_data;
+    std::vector<StateQRR14> states;
+    std::vector<int32_t> actions;
+    std::vector<unsigned int> action_offset, transition_offset;
+    std::vector<TransitionQRR14> transitions;
+    uint64_t stored_checksum;
+    bool valid = 
+      readArray(ifs, adjacent_offsets, file_size, checksum) &&
+      readArray(ifs, adjacent_data, file_size, checksum) &&
+      readArray(ifs, visible_offsets, file_size, checksum) &&
+      readArray(ifs, visible_data, file_size, checksum) &&
+      readArray(ifs, states, file_size, checksum) &&
+      readArray(ifs, actions, file_size, checksum) &&
+      readArray(ifs, action_offset, file_size, checksum) &&
+      readArray(ifs, transition_offset, file_size, checksum) &&
+      readArray(ifs, transitions, file_size, checksum) &&
+      ifs.read(reinterpret_cast<char*>(&stored_checksum), 
+          sizeof(stored_checksum)) &&
+      stored_checksum == checksum;
+
+    num_vertices_ = header.num_vertices;
+    valid = valid &&
+      unflattenVertexMap(adjacent_offsets, adjacent_data, num_vertices_,
+          structure_->adjacent_vertices_map) &&
+      unflattenVertexMap(visible_offsets, visible_data, num_vertices_,
+          structure_->visible_vertices_map) &&
+      actions.size() % 2 == 0 &&
+      action_offset.size() == states.size() + 1 &&
+      action_offset.back() == actions.size() / 2 &&
+      transition_offset.size() == actions.size() / 2 + 1 &&
+      transition_offset.back() == transitions.size();
+    if (!valid) {
+      std::cout << "PersonModel: Ignoring model cache " << file << 
+        " (corrupt or truncated)" << std::endl;
+      return false;
+    }
+
+    structure_->state_cache.swap(states);
+    structure_->action_cache.resize(actions.size() / 2);
+    for (size_t action_idx = 0; action_idx < actions.size() / 2; 
+        ++action_idx) {
+      structure_->action_cache[action_idx] = ActionQRR14(
+          (ActionType) actions[2 * action_idx], actions[2 * action_idx + 1]);
+    }
+    structure_->action_offset.swap(action_offset);
+    structure_->transition_offset.swap(transition_offset);
+    transition_cache_.swap(transitions);
+
+    initializeStateIndex();
+    initializeGoalTransitions(header.goal_idx);
+    initializeRewardCache();
+    return true;
+  }
+
+  void PersonModelQRR14::saveModelCache(const std::string& file) const {
+
+    ModelCacheHeader header;
+    memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_CACHE_VERSION;
+    header.layout = MODEL_CACHE_LAYOUT;
+    header.key = computeCacheKey();
+    header.goal_idx = goal_idx_;
+    header.num_vertices = num_vertices_;
+
+    std::vector<int> adjacent_offsets, adjacent_data;
+    std::vector<int> visible_offsets, visible_data;
+    flattenVertexMap(structure_->adjacent_vertices_map, num_vertices_,
+        adjacent_offsets, adjacent_data);
+    flattenVertexMap(structure_->visible_vertices_map, num_vertices_,
+        visible_offsets, visible_data);
+    std::vector<int32_t> actions;
+    actions.reserve(2 * structure_->action_cache.size());
+    BOOST_FOREACH(const ActionQRR14& action, structure_->action_cache) {
+      actions.push_back(action.type);
+      actions.push_back(action.graph_id);
+    }
+
+    // Write to a temporary file and move it in place, so that other
+    // processes sharing the cache never read a partially written file
+    std::ostringstream temp_file_stream;
+    temp_file_stream << file << ".tmp" << getpid();
+    std::string temp_file = temp_file_stream.str();
+    std::ofstream ofs(temp_file.c_str(), std::ios::binary | std::ios::trunc);
+    uint64_t checksum = FNV_OFFSET_BASIS;
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeArray(ofs, adjacent_offsets, checksum);
+    writeArray(ofs, adjacent_data, checksum);
+    writeArray(ofs, visible_offsets, checksum);
+    writeArray(ofs, visible_data, checksum);
+    writeArray(ofs, structure_->state_cache, checksum);
+    writeArray(ofs, actions, checksum);
+    writeArray(ofs, structure_->action_offset, checksum);
+    writeArray(ofs, structure_->transition_offset, checksum);
+    writeArray(ofs, transition_cache_, checksum);
+    ofs.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    ofs.close();
+
+    if (!ofs || std::rename(temp_file.c_str(), file.c_str()) != 0) {
+      std::cerr << "PersonModel: Unable to save model cache to " << file << 
+        std::endl;
+      std::remove(temp_file.c_str());
+    }
+  }
+
+  std::string getModelCacheFileQRR14(const std::string& directory,
+      bool allow_robot_current_idx, float visibility_range,
+      bool allow_goal_visibility, unsigned int max_robots) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << directory << "qrr14_model_robots" << max_robots << "_visibility" <<
+      visibility_range << "_current" << allow_robot_current_idx << 
+      "_goalVisible" << allow_goal_visibility;
+    return ss.str();
   }
 
 } /* bwi_guidance */
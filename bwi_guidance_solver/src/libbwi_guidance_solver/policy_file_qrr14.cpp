@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <bwi_guidance_solver/policy_file_qrr14.h>
+
+namespace bwi_guidance {
+
+  bool isPolicyFileQRR14(const std::string& file) {
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    char magic[sizeof(POLICY_FILE_MAGIC)];
+    if (!ifs.read(magic, sizeof(magic))) {
+      return false;
+    }
+    return memcmp(magic, POLICY_FILE_MAGIC, sizeof(magic)) == 0;
+  }
+
+  void writePolicyFileQRR14(const std::string& file,
+      uint32_t state_space_checksum, const std::vector<float>& values,
+      const std::vector<PolicyFileActionQRR14>& actions) {
+
+    if (values.size() != actions.size()) {
+      throw std::runtime_error("writePolicyFileQRR14: number of values and "
+          "actions differ");
+    }
+
+    PolicyFileHeaderQRR14 header;
+    memcpy(header.magic, POLICY_FILE_MAGIC, sizeof(header.magic));
+    header.version = POLICY_FILE_VERSION;
+    header.num_states = values.size();
+    header.state_space_checksum = state_space_checksum;
+    header.reserved = 0;
+
+    // Write to a temporary file and move it in place. Other processes may
+    // have the file mapped, and truncating it under them would fault.
+    std::ostringstream temp_file_stream;
+    temp_file_stream << file << ".tmp" << getpid();
+    std::string temp_file = temp_file_stream.str();
+    std::ofstream ofs(temp_file.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!values.empty()) {
+      ofs.write(reinterpret_cast<const char*>(&values[0]),
+          values.size() * sizeof(float));
+      ofs.write(reinterpret_cast<const char*>(&actions[0]),
+          actions.size() * sizeof(PolicyFileActionQRR14));
+    }
+    ofs.close();
+    if (!ofs || std::rename(temp_file.c_str(), file.c_str()) != 0) {
+      std::remove(temp_file.c_str());
+      throw std::runtime_error("writePolicyFileQRR14: unable to write " +
+          file);
+    }
+  }
+
+  void savePolicyFileQRR14(const std::string& file,
+      const PersonModelQRR14& model, PersonEstimatorQRR14& estimator) {
+
+    unsigned int num_states = model.getNumStates();
+    std::vector<float> values(num_states);
+    std::vector<PolicyFileActionQRR14> actions(num_states);
+    bool indexed = estimator.isIndexed() && 
+      estimator.getStateSpaceChecksum() == model.getStateSpaceChecksum();
+    for (unsigned int state_idx = 0; state_idx < num_states; ++state_idx) {
+      const StateQRR14& state = model.getState(state_idx);
+      bool has_best_action;
+      if (indexed) {
+        values[state_idx] = estimator.getValueByIndex(state_idx);
+        has_best_action = estimator.hasBestActionByIndex(state_idx);
+      } else {
+        values[state_idx] = estimator.getValue(state);
+        has_best_action = estimator.hasBestAction(state);
+      }
+      if (has_best_action) {
+        ActionQRR14 action = estimator.getBestAction(state);
+        actions[state_idx].type = action.type;
+        actions[state_idx].graph_id = action.graph_id;
+      } else {
+        actions[state_idx].type = NONE;
+        actions[state_idx].graph_id = 0;
+      }
+    }
+
+    writePolicyFileQRR14(file, model.getStateSpaceChecksum(), values,
+        actions);
+  }
+
+  MappedPolicyQRR14::MappedPolicyQRR14(const std::string& file) {
+
+    try {
+      file_ = boost::interprocess::file_mapping(file.c_str(),
+          boost::interprocess::read_only);
+      region_ = boost::interprocess::mapped_region(file_,
+          boost::interprocess::read_only);
+    } catch (const boost::interprocess::interprocess_exception& e) {
+      throw std::runtime_error("MappedPolicyQRR14: unable to map " + file +
+          ": " + e.what());
+    }
+
+    const char* data = static_cast<const char*>(region_.get_address());
+    size_t size = region_.get_size();
+
+    if (size < sizeof(PolicyFileHeaderQRR14)) {
+      throw std::runtime_error("MappedPolicyQRR14: " + file +
+          " is too small to be a policy file");
+    }
+    header_ = reinterpret_cast<const PolicyFileHeaderQRR14*>(data);
+    if (memcmp(header_->magic, POLICY_FILE_MAGIC, sizeof(header_->magic))) {
+      throw std::runtime_error("MappedPolicyQRR14: " + file +
+          " is not a policy file");
+    }
+    if (header_->version != POLICY_FILE_VERSION) {
+      throw std::runtime_error("MappedPolicyQRR14: " + file +
+          " has unsupported version " +
+          boost::lexical_cast<std::string>(header_->version));
+    }
+
+    size_t expected_size = sizeof(PolicyFileHeaderQRR14) +
+      (size_t) header_->num_states *
+      (sizeof(float) + sizeof(PolicyFileActionQRR14));
+    if (size != expected_size) {
+      throw std::runtime_error("MappedPolicyQRR14: " + file +
+          " is truncated or corrupt");
+    }
+
+    values_ = reinterpret_cast<const float*>(
+        data + sizeof(PolicyFileHeaderQRR14));
+    actions_ = reinterpret_cast<const PolicyFileActionQRR14*>(
+        values_ + header_->num_states);
+  }
+
+  void MappedPolicyQRR14::checkModel(const PersonModelQRR14& model) const {
+    if (header_->num_states != model.getNumStates() ||
+        header_->state_space_checksum != model.getStateSpaceChecksum()) {
+      throw std::runtime_error("MappedPolicyQRR14: policy was computed for "
+          "a different state space than the model. Were the model "
+          "parameters changed?");
+    }
+  }
+
+} /* bwi_guidance */
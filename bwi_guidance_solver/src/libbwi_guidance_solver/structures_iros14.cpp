@@ -186,4 +186,96 @@ namespace bwi_guidance {
     return stream;
   }
 
+  namespace {
+
+    inline uint64_t hashInt(int value, uint64_t hash) {
+      return hashBytes(&value, sizeof(value), hash);
+    }
+
+    inline uint64_t hashFloat(float value, uint64_t hash) {
+      // 0.0f and -0.0f compare equal, and need to hash the same
+      if (value == 0.0f) {
+        value = 0.0f;
+      }
+      return hashBytes(&value, sizeof(value), hash);
+    }
+
+  }
+
+  uint64_t hashState(const StateIROS14& s, StateEquivalence equivalence) {
+    uint64_t hash = hashInt(s.graph_id, FNV_OFFSET_BASIS);
+    hash = hashInt(s.direction, hash);
+    hash = hashInt(s.in_use_robots.size(), hash);
+    for (unsigned int i = 0; i < s.in_use_robots.size(); ++i) {
+      const InUseRobotStateIROS14& robot = s.in_use_robots[i];
+      hash = hashInt(robot.destination, hash);
+      hash = hashInt(robot.direction, hash);
+      hash = hashInt(robot.reached_destination, hash);
+    }
+    hash = hashInt(s.acquired_locations.size(), hash);
+    for (unsigned int i = 0; i < s.acquired_locations.size(); ++i) {
+      hash = hashInt(s.acquired_locations[i], hash);
+    }
+    hash = hashInt(s.relieved_locations.size(), hash);
+    for (unsigned int i = 0; i < s.relieved_locations.size(); ++i) {
+      hash = hashInt(s.relieved_locations[i], hash);
+    }
+
+    if (equivalence == EXACT_STATE_EQUIVALENCE) {
+      hash = hashFloat(s.precision, hash);
+      hash = hashInt(s.from_graph_node, hash);
+      hash = hashInt(s.robot_gave_direction, hash);
+      for (unsigned int i = 0; i < s.in_use_robots.size(); ++i) {
+        hash = hashInt(s.in_use_robots[i].robot_id, hash);
+      }
+      hash = hashInt(s.robots.size(), hash);
+      for (unsigned int i = 0; i < s.robots.size(); ++i) {
+        const RobotStateIROS14& robot = s.robots[i];
+        hash = hashInt(robot.graph_id, hash);
+        hash = hashInt(robot.destination, hash);
+        hash = hashFloat(robot.precision, hash);
+        hash = hashInt(robot.other_graph_node, hash);
+      }
+    }
+
+    return hash;
+  }
+
+  bool equalStates(const StateIROS14& l, const StateIROS14& r, 
+      StateEquivalence equivalence) {
+    if (!(l == r)) {
+      return false;
+    }
+    if (equivalence == ABSTRACT_STATE_EQUIVALENCE) {
+      return true;
+    }
+
+    if (l.precision != r.precision ||
+        l.from_graph_node != r.from_graph_node ||
+        l.robot_gave_direction != r.robot_gave_direction ||
+        l.robots.size() != r.robots.size()) {
+      return false;
+    }
+    for (unsigned int i = 0; i < l.in_use_robots.size(); ++i) {
+      if (l.in_use_robots[i].robot_id != r.in_use_robots[i].robot_id) {
+        return false;
+      }
+    }
+    for (unsigned int i = 0; i < l.robots.size(); ++i) {
+      const RobotStateIROS14& lr = l.robots[i];
+      const RobotStateIROS14& rr = r.robots[i];
+      if (lr.graph_id != rr.graph_id ||
+          lr.destination != rr.destination ||
+          lr.precision != rr.precision ||
+          lr.other_graph_node != rr.other_graph_node) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::size_t hash_value(const StateIROS14& s) {
+    return hashState(s, ABSTRACT_STATE_EQUIVALENCE);
+  }
+
 } /* bwi_guidance */
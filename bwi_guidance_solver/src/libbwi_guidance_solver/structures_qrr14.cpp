@@ -65,4 +65,21 @@ namespace bwi_guidance {
     return stream;
   }
 
+  uint64_t hashState(const StateQRR14& s, StateEquivalence equivalence) {
+    uint64_t hash = hashBytes(&s.graph_id, sizeof(s.graph_id));
+    hash = hashBytes(&s.direction, sizeof(s.direction), hash);
+    hash = hashBytes(&s.num_robots_left, sizeof(s.num_robots_left), hash);
+    hash = hashBytes(&s.robot_direction, sizeof(s.robot_direction), hash);
+    return hashBytes(&s.visible_robot, sizeof(s.visible_robot), hash);
+  }
+
+  bool equalStates(const StateQRR14& l, const StateQRR14& r, 
+      StateEquivalence equivalence) {
+    return l == r;
+  }
+
+  std::size_t hash_value(const StateQRR14& s) {
+    return hashState(s, ABSTRACT_STATE_EQUIVALENCE);
+  }
+
 } /* bwi_guidance */
@@ -0,0 +1,481 @@
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <cmath>
+#include <iostream>
+#include <queue>
+
+#include <bwi_guidance_solver/value_iteration_qrr14.h>
+
+#ifdef VI_DEBUG
+#define VI_OUTPUT(x) std::cout << x << std::endl
+#else
+#define VI_OUTPUT(x) ((void) 0)
+#endif
+
+namespace bwi_guidance {
+
+  ValueIterationQRR14::ValueIterationQRR14(
+      const boost::shared_ptr<PersonModelQRR14>& model,
+      const boost::shared_ptr<PersonEstimatorQRR14>& estimator,
+      float gamma, float epsilon, unsigned int max_iter, float max_value,
+      float min_value, unsigned int num_threads, ValueIterationMode mode) :
+  model_(model), estimator_(estimator), gamma_(gamma), epsilon_(epsilon),
+  max_iter_(max_iter), max_value_(max_value), min_value_(min_value),
+  num_threads_(num_threads), mode_(mode), num_backups_(0) {
+    if (num_threads_ == 0) {
+      num_threads_ = std::max(1u, boost::thread::hardware_concurrency());
+    }
+  }
+
+  void ValueIterationQRR14::computePolicy() {
+
+    mapped_policy_.reset();
+
+    unsigned int num_states = model_->getNumStates();
+    values_.assign(num_states, 0.0f);
+    next_values_.clear();
+    best_actions_.assign(num_states, -1);
+    num_backups_ = 0;
+    residual_history_.clear();
+
+    if (mode_ == PRIORITIZED_SWEEP) {
+      computePolicyPrioritized();
+    } else {
+      computePolicySynchronous();
+    }
+
+    VI_OUTPUT("ValueIterationQRR14: " << num_backups_ << " backups (" <<
+        getNumSweeps() << " sweeps)");
+
+    // Write out the computed values and policy to the estimator. Estimators
+    // indexed by the same state space are written to directly by state id.
+    bool indexed = estimator_->isIndexed() && 
+      estimator_->getStateSpaceChecksum() == model_->getStateSpaceChecksum();
+    for (unsigned int state_idx = 0; state_idx < num_states; ++state_idx) {
+      if (indexed) {
+        estimator_->updateValueByIndex(state_idx, values_[state_idx]);
+        if (best_actions_[state_idx] != -1) {
+          estimator_->setBestActionByIndex(state_idx,
+              model_->getAction(best_actions_[state_idx]));
+        }
+      } else {
+        const StateQRR14& state = model_->getState(state_idx);
+        estimator_->updateValue(state, values_[state_idx]);
+        if (best_actions_[state_idx] != -1) {
+          estimator_->setBestAction(state,
+              model_->getAction(best_actions_[state_idx]));
+        }
+      }
+    }
+  }
+
+  void ValueIterationQRR14::computePolicySynchronous() {
+
+    unsigned int num_states = model_->getNumStates();
+    next_values_.assign(num_states, 0.0f);
+
+    unsigned int num_non_terminal_states = 0;
+    for (unsigned int state_idx = 0; state_idx < num_states; ++state_idx) {
+      if (!model_->isTerminalState(model_->getState(state_idx))) {
+        ++num_non_terminal_states;
+      }
+    }
+
+    // Partition the state space into contiguous blocks, one per thread
+    unsigned int num_threads = std::min(num_threads_,
+        std::max(1u, num_states));
+    std::vector<unsigned int> block_start(num_threads + 1);
+    for (unsigned int t = 0; t <= num_threads; ++t) {
+      block_start[t] = ((unsigned long)num_states * t) / num_threads;
+    }
+    std::vector<float> block_max_change(num_threads);
+
+    VI_OUTPUT("ValueIterationQRR14: " << num_states << " states, " <<
+        num_threads << " threads");
+
+    // The workers are started once, and compute a block of every sweep.
+    // The calling thread computes the first block and runs the sweep loop
+    // in between the two barriers of each sweep.
+    boost::barrier sweep_barrier(num_threads);
+    bool sweeps_done = false;
+    boost::thread_group workers;
+    for (unsigned int t = 1; t < num_threads; ++t) {
+      workers.create_thread(boost::bind(
+            &ValueIterationQRR14::runSweepWorker, this, block_start[t],
+            block_start[t + 1], boost::ref(block_max_change[t]),
+            boost::ref(sweep_barrier), boost::ref(sweeps_done)));
+    }
+
+    for (unsigned int iter = 0; iter < max_iter_; ++iter) {
+
+      sweep_barrier.wait();
+      computeValues(block_start[0], block_start[1], block_max_change[0]);
+      sweep_barrier.wait();
+
+      values_.swap(next_values_);
+      num_backups_ += num_non_terminal_states;
+      float max_change =
+        *std::max_element(block_max_change.begin(), block_max_change.end());
+      residual_history_.push_back(max_change);
+      VI_OUTPUT("  Iteration #" << iter << ", max change: " << max_change);
+      if (max_change < epsilon_) {
+        break;
+      }
+    }
+
+    sweeps_done = true;
+    sweep_barrier.wait();
+    workers.join_all();
+  }
+
+  void ValueIterationQRR14::runSweepWorker(unsigned int start_idx, 
+      unsigned int end_idx, float& max_change, boost::barrier& sweep_barrier,
+      const bool& sweeps_done) {
+    while (true) {
+      // The barriers also publish values_ and sweeps_done from the calling
+      // thread
+      sweep_barrier.wait();
+      if (sweeps_done) {
+        return;
+      }
+      computeValues(start_idx, end_idx, max_change);
+      sweep_barrier.wait();
+    }
+  }
+
+  void ValueIterationQRR14::computePolicyPrioritized() {
+
+    int num_states = model_->getNumStates();
+
+    /* Predecessor lists in CSR form. Each transition s -a-> s' adds the entry
+     * (s, p(s'|s,a)) to the list of s'. A change of d in V(s') can change
+     * V(s) by at most gamma * d * the sum of these probabilities, so
+     * accumulating that amount gives an upper bound on the residual of s. */
+    std::vector<int> predecessor_offset(num_states + 1, 0);
+    for (int state_idx = 0; state_idx < num_states; ++state_idx) {
+      for (unsigned int action_idx = model_->getActionsBegin(state_idx);
+          action_idx < model_->getActionsEnd(state_idx); ++action_idx) {
+        const TransitionQRR14* transitions_end =
+          model_->getTransitionsEnd(action_idx);
+        for (const TransitionQRR14* transition =
+            model_->getTransitionsBegin(action_idx);
+            transition != transitions_end; ++transition) {
+          ++predecessor_offset[transition->next_state_idx + 1];
+        }
+      }
+    }
+    for (int state_idx = 0; state_idx < num_states; ++state_idx) {
+      predecessor_offset[state_idx + 1] += predecessor_offset[state_idx];
+    }
+    std::vector<int> predecessor_state(predecessor_offset[num_states]);
+    std::vector<float> predecessor_probability(predecessor_offset[num_states]);
+    std::vector<int> fill(predecessor_offset.begin(),
+        predecessor_offset.end() - 1);
+    for (int state_idx = 0; state_idx < num_states; ++state_idx) {
+      for (unsigned int action_idx = model_->getActionsBegin(state_idx);
+          action_idx < model_->getActionsEnd(state_idx); ++action_idx) {
+        const TransitionQRR14* transitions_end =
+          model_->getTransitionsEnd(action_idx);
+        for (const TransitionQRR14* transition =
+            model_->getTransitionsBegin(action_idx);
+            transition != transitions_end; ++transition) {
+          int entry = fill[transition->next_state_idx]++;
+          predecessor_state[entry] = state_idx;
+          predecessor_probability[entry] = transition->probability;
+        }
+      }
+    }
+
+    /* Order states by their distance (in transitions) from the goal, using a
+     * breadth first search backwards from the terminal states. States that
+     * cannot reach the goal are placed at the end. */
+    std::vector<bool> terminal(num_states, false);
+    std::vector<bool> ordered(num_states, false);
+    std::vector<int> order;
+    order.reserve(num_states);
+    for (int state_idx = 0; state_idx < num_states; ++state_idx) {
+      if (model_->isTerminalState(model_->getState(state_idx))) {
+        terminal[state_idx] = true;
+        ordered[state_idx] = true;
+        order.push_back(state_idx);
+        unsigned int actions_begin = model_->getActionsBegin(state_idx);
+        if (actions_begin != model_->getActionsEnd(state_idx)) {
+          best_actions_[state_idx] = actions_begin;
+        }
+      }
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+      int state_idx = order[head];
+      for (int entry = predecessor_offset[state_idx]; 
+          entry < predecessor_offset[state_idx + 1]; ++entry) {
+        int pred_idx = predecessor_state[entry];
+        if (!ordered[pred_idx]) {
+          ordered[pred_idx] = true;
+          order.push_back(pred_idx);
+        }
+      }
+    }
+    for (int state_idx = 0; state_idx < num_states; ++state_idx) {
+      if (!ordered[state_idx]) {
+        order.push_back(state_idx);
+      }
+    }
+
+    // priority holds an upper bound on each state's current residual
+    std::vector<float> priority(num_states, 0.0f);
+    typedef std::pair<float, int> QueueEntry;
+    std::priority_queue<QueueEntry> queue;
+    unsigned long max_backups = (unsigned long) max_iter_ * num_states;
+    bool first_sweep = true;
+
+    for (size_t position = 0; ; ++position) {
+
+      int state_idx;
+      if (position < order.size()) {
+        state_idx = order[position];
+        if (terminal[state_idx]) {
+          continue;
+        }
+      } else {
+        if (first_sweep) {
+          // Seed the queue with the residuals remaining after the first sweep
+          first_sweep = false;
+          float max_priority = 0.0f;
+          for (int i = 0; i < num_states; ++i) {
+            if (priority[i] >= epsilon_) {
+              queue.push(QueueEntry(priority[i], i));
+            }
+            max_priority = std::max(max_priority, priority[i]);
+          }
+          residual_history_.push_back(max_priority);
+          VI_OUTPUT("  Ordered sweep complete, max residual: " <<
+              max_priority);
+        }
+        // Discard stale queue entries
+        while (!queue.empty() && 
+            queue.top().first != priority[queue.top().second]) {
+          queue.pop();
+        }
+        if (queue.empty() || num_backups_ >= max_backups) {
+          break;
+        }
+        state_idx = queue.top().second;
+        queue.pop();
+      }
+
+      int best_action;
+      float value = backupState(state_idx, best_action);
+      float change = fabsf(value - values_[state_idx]);
+      values_[state_idx] = value;
+      if (best_action != -1) {
+        best_actions_[state_idx] = best_action;
+      }
+      priority[state_idx] = 0.0f;
+      ++num_backups_;
+
+      if (change != 0.0f) {
+        for (int entry = predecessor_offset[state_idx]; 
+            entry < predecessor_offset[state_idx + 1]; ++entry) {
+          int pred_idx = predecessor_state[entry];
+          if (terminal[pred_idx]) {
+            continue;
+          }
+          priority[pred_idx] +=
+            gamma_ * predecessor_probability[entry] * change;
+          if (!first_sweep && priority[pred_idx] >= epsilon_) {
+            queue.push(QueueEntry(priority[pred_idx], pred_idx));
+          }
+        }
+      }
+
+      if (!first_sweep && num_backups_ % num_states == 0) {
+        while (!queue.empty() && 
+            queue.top().first != priority[queue.top().second]) {
+          queue.pop();
+        }
+        float max_priority = queue.empty() ? 0.0f : queue.top().first;
+        residual_history_.push_back(max_priority);
+        VI_OUTPUT("  Backup #" << num_backups_ << ", max residual: " <<
+            max_priority);
+      }
+    }
+
+    float final_priority = 
+      *std::max_element(priority.begin(), priority.end());
+    if (residual_history_.empty() || 
+        residual_history_.back() != final_priority) {
+      residual_history_.push_back(final_priority);
+    }
+  }
+
+  void ValueIterationQRR14::computeValues(unsigned int start_idx,
+      unsigned int end_idx, float& max_change) {
+
+    max_change = 0.0f;
+    for (unsigned int state_idx = start_idx; state_idx < end_idx;
+        ++state_idx) {
+
+      if (model_->isTerminalState(model_->getState(state_idx))) {
+        unsigned int actions_begin = model_->getActionsBegin(state_idx);
+        unsigned int actions_end = model_->getActionsEnd(state_idx);
+        next_values_[state_idx] = 0.0f;
+        best_actions_[state_idx] =
+          (actions_begin != actions_end) ? (int)actions_begin : -1;
+        continue;
+      }
+
+      int best_action;
+      float value = backupState(state_idx, best_action);
+      max_change = std::max(max_change, fabsf(value - values_[state_idx]));
+      next_values_[state_idx] = value;
+      if (best_action != -1) {
+        best_actions_[state_idx] = best_action;
+      }
+    }
+  }
+
+  float ValueIterationQRR14::backupState(int state_idx,
+      int& best_action) const {
+
+    float best_value = -std::numeric_limits<float>::max();
+    best_action = -1;
+    for (unsigned int action_idx = model_->getActionsBegin(state_idx);
+        action_idx < model_->getActionsEnd(state_idx); ++action_idx) {
+      float value = 0.0f;
+      const TransitionQRR14* transitions_end =
+        model_->getTransitionsEnd(action_idx);
+      for (const TransitionQRR14* transition =
+          model_->getTransitionsBegin(action_idx);
+          transition != transitions_end; ++transition) {
+        value += transition->probability * (transition->reward +
+            gamma_ * values_[transition->next_state_idx]);
+      }
+      if (value > best_value) {
+        best_value = value;
+        best_action = action_idx;
+      }
+    }
+
+    if (best_action == -1) {
+      // No actions available here
+      return values_[state_idx];
+    }
+    return std::min(max_value_, std::max(min_value_, best_value));
+  }
+
+  ActionQRR14 ValueIterationQRR14::getBestAction(const StateQRR14& state) {
+    if (mapped_policy_) {
+      ActionQRR14 action;
+      int state_idx = model_->getStateIndex(state);
+      if (state_idx != -1) {
+        mapped_policy_->getBestAction(state_idx, action);
+      }
+      return action;
+    }
+    return estimator_->getBestAction(state);
+  }
+
+  void ValueIterationQRR14::loadPolicy(const std::string& file) {
+    if (isPolicyFileQRR14(file)) {
+      boost::shared_ptr<MappedPolicyQRR14> policy(new MappedPolicyQRR14(file));
+      policy->checkModel(*model_);
+      mapped_policy_ = policy;
+    } else {
+      mapped_policy_.reset();
+      estimator_->loadEstimatedValues(file);
+    }
+  }
+
+  void ValueIterationQRR14::savePolicy(const std::string& file) {
+    if (mapped_policy_) {
+      throw std::runtime_error("ValueIterationQRR14: policy loaded from a "
+          "flat policy file cannot be saved in the estimator's format");
+    }
+    estimator_->saveEstimatedValues(file);
+  }
+
+  void ValueIterationQRR14::saveFlatPolicy(const std::string& file) {
+    if (mapped_policy_) {
+      throw std::runtime_error("ValueIterationQRR14: policy is already "
+          "stored in a flat policy file");
+    }
+    savePolicyFileQRR14(file, *model_, *estimator_);
+  }
+
+  namespace {
+
+    /* State shared by the worker threads of computePoliciesForGoals() */
+    struct GoalQueue {
+      boost::shared_ptr<PersonModelQRR14> model;
+      std::vector<int> goals;
+      size_t next_goal;
+      boost::mutex mutex;
+    };
+
+    void solveGoals(GoalQueue& queue, const GoalPolicyCallback& callback,
+        float gamma, float epsilon, unsigned int max_iter, float max_value,
+        float min_value, unsigned int vi_threads, ValueIterationMode mode) {
+      while (true) {
+        int goal_idx;
+        {
+          boost::mutex::scoped_lock lock(queue.mutex);
+          if (queue.next_goal >= queue.goals.size()) {
+            return;
+          }
+          goal_idx = queue.goals[queue.next_goal];
+          ++queue.next_goal;
+        }
+
+        boost::shared_ptr<PersonModelQRR14> model = queue.model;
+        if (model->getGoalIdx() != goal_idx) {
+          model.reset(new PersonModelQRR14(*queue.model, goal_idx));
+        }
+        boost::shared_ptr<PersonEstimatorQRR14> estimator(
+            new PersonEstimatorQRR14(model));
+        boost::shared_ptr<ValueIterationQRR14> vi(
+            new ValueIterationQRR14(model, estimator, gamma, epsilon,
+              max_iter, max_value, min_value, vi_threads, mode));
+        vi->computePolicy();
+        callback(vi);
+      }
+    }
+
+  } /* anonymous namespace */
+
+  void computePoliciesForGoals(
+      const boost::shared_ptr<PersonModelQRR14>& model,
+      const std::vector<int>& goals, const GoalPolicyCallback& callback,
+      float gamma, float epsilon, unsigned int max_iter, float max_value,
+      float min_value, unsigned int num_threads, ValueIterationMode mode) {
+
+    if (num_threads == 0) {
+      num_threads = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    // Parallelize over goals first, and use any remaining threads within VI
+    unsigned int goal_threads = 
+      std::max(1u, std::min(num_threads, (unsigned int)goals.size()));
+    unsigned int vi_threads = std::max(1u, num_threads / goal_threads);
+
+    GoalQueue queue;
+    queue.model = model;
+    queue.goals = goals;
+    queue.next_goal = 0;
+
+    if (goal_threads == 1) {
+      solveGoals(queue, callback, gamma, epsilon, max_iter, max_value,
+          min_value, vi_threads, mode);
+      return;
+    }
+
+    boost::thread_group threads;
+    for (unsigned int t = 0; t < goal_threads; ++t) {
+      threads.create_thread(boost::bind(&solveGoals, boost::ref(queue),
+            boost::cref(callback), gamma, epsilon, max_iter, max_value,
+            min_value, vi_threads, mode));
+    }
+    threads.join_all();
+  }
+
+} /* bwi_guidance */
@@ -0,0 +1,125 @@
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/program_options.hpp>
+
+#include <bwi_guidance_solver/person_estimator_qrr14.h>
+#include <bwi_guidance_solver/person_model_qrr14.h>
+#include <bwi_guidance_solver/policy_file_qrr14.h>
+#include <bwi_mapper/map_loader.h>
+#include <bwi_mapper/map_utils.h>
+
+/* Converts policies saved by PersonEstimatorQRR14 (the *_vi files written by
+ * evaluate_qrr14 and robot_positioner_qrr14) to the flat policy format. The
+ * state space does not depend on the goal, so a single model is used to
+ * convert the policies for all goals. Each input file is written next to
+ * the original (or in output-directory) with a .bin extension. */
+
+using namespace bwi_guidance;
+
+/* Parameters (with their defaults) */
+std::string map_file_ = "";
+std::string graph_file_ = "";
+std::string output_directory_ = "";
+std::vector<std::string> policy_files_;
+bool allow_robot_current_idx_ = false;
+float visibility_range_ = 0.0f; // Infinite visibility
+unsigned int max_robots_ = 5;
+
+int processOptions(int argc, char** argv) {
+
+  namespace po = boost::program_options;
+  po::options_description desc("Options");
+  desc.add_options()
+    ("map-file", po::value<std::string>(&map_file_)->required(),
+     "YAML map file")
+    ("graph-file", po::value<std::string>(&graph_file_)->required(),
+     "YAML graph file corresponding to the map")
+    ("policy-file",
+     po::value<std::vector<std::string> >(&policy_files_)->required(),
+     "Policy file(s) to convert")
+    ("output-directory", po::value<std::string>(&output_directory_),
+     "Output directory (defaults to the directory of each policy file)")
+    ("allow-robot-current", "Allow robot to be placed at current index")
+    ("visibility-range", po::value<float>(&visibility_range_),
+     "Visibility range in meters used while computing the policies.")
+    ("max-robots", po::value<unsigned int>(&max_robots_),
+     "Maximum number of robots used while computing the policies.");
+
+  po::positional_options_description positional_options;
+  positional_options.add("policy-file", -1);
+
+  po::variables_map vm;
+
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+        .positional(positional_options).run(), vm); // throws on error
+    po::notify(vm);
+  } catch(boost::program_options::error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+    std::cout << desc << std::endl;
+    return -1;
+  }
+
+  if (vm.count("allow-robot-current")) {
+    allow_robot_current_idx_ = true;
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+
+  int ret = processOptions(argc, argv);
+  if (ret != 0) {
+    return ret;
+  }
+
+  bwi_mapper::MapLoader mapper(map_file_);
+  bwi_mapper::Graph graph;
+  nav_msgs::OccupancyGrid map;
+  mapper.getMap(map);
+  bwi_mapper::readGraphFromFile(graph_file_, map.info, graph);
+
+  // The goal does not affect the state space, any vertex will do
+  float pixel_visibility_range = visibility_range_ / map.info.resolution;
+  PersonModelQRR14 model(graph, map, 0, "", allow_robot_current_idx_,
+      pixel_visibility_range, false, max_robots_);
+
+  BOOST_FOREACH(const std::string& policy_file, policy_files_) {
+
+    if (isPolicyFileQRR14(policy_file)) {
+      std::cout << policy_file << " is already a flat policy file. " <<
+        "Skipping..." << std::endl;
+      continue;
+    }
+
+    boost::filesystem::path output_file(policy_file);
+    output_file.replace_extension(".bin");
+    if (!output_directory_.empty()) {
+      output_file = boost::filesystem::path(output_directory_) /
+        output_file.filename();
+    }
+
+    PersonEstimatorQRR14 estimator;
+    estimator.loadEstimatedValues(policy_file);
+
+    unsigned int missing_states = 0;
+    for (unsigned int state_idx = 0; state_idx < model.getNumStates();
+        ++state_idx) {
+      if (!estimator.hasBestAction(model.getState(state_idx))) {
+        ++missing_states;
+      }
+    }
+    if (missing_states != 0) {
+      std::cerr << "WARNING: " << policy_file << " has no action for " <<
+        missing_states << " of " << model.getNumStates() << " states. " <<
+        "Check visibility-range and max-robots." << std::endl;
+    }
+
+    savePolicyFileQRR14(output_file.string(), model, estimator);
+    std::cout << "Converted " << policy_file << " to " <<
+      output_file.string() << std::endl;
+  }
+
+  return 0;
+}
@@ -15,8 +15,12 @@
 
 #include <opencv/highgui.h>
 
+#include <bwi_guidance_solver/anytime_planner.h>
 #include <bwi_guidance_solver/heuristic_solver_iros14.h>
 #include <bwi_guidance_solver/person_model_iros14.h>
+#include <bwi_guidance_solver/root_parallel_uct_planner.h>
+#include <bwi_guidance_solver/tree_parallel_uct_planner.h>
+#include <bwi_guidance_solver/uct_planner.h>
 #include <bwi_guidance_solver/utils.h>
 #include <bwi_mapper/map_loader.h>
 #include <bwi_mapper/map_utils.h>
@@ -93,7 +97,15 @@ namespace Method {
   _(float,robot_speed,robot_speed,0.5f) \
   _(float,utility_multiplier,utility_multiplier,1.0f) \
   _(bool,use_shaping_reward,use_shaping_reward,true) \
-  _(bool,discourage_bad_assignments,discourage_bad_assignments,false) 
+  _(bool,discourage_bad_assignments,discourage_bad_assignments,false) \
+  _(bool,mcts_transposition_table,mcts_transposition_table,false) \
+  _(bool,mcts_exact_state_equivalence,mcts_exact_state_equivalence,false) \
+  _(int,mcts_max_depth,mcts_max_depth,0) \
+  _(int,mcts_num_threads,mcts_num_threads,1) \
+  _(bool,mcts_tree_parallel,mcts_tree_parallel,false) \
+  _(bool,mcts_reuse_tree,mcts_reuse_tree,false) \
+  _(bool,mcts_anytime,mcts_anytime,false) \
+  _(float,mcts_decision_time,mcts_decision_time,0.1f) 
 
   Params_STRUCT(PARAMS)
 #undef PARAMS
@@ -142,20 +154,15 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
 
     boost::shared_ptr<HeuristicSolverIROS14> hs;
     boost::shared_ptr<MCTS<StateIROS14, ActionIROS14> > mcts;
+    boost::shared_ptr<SearchPlanner<StateIROS14, ActionIROS14> > uct;
+    boost::shared_ptr<AnytimePlanner<StateIROS14, ActionIROS14> > anytime;
 
-    if (params.type == MCTS_TYPE) {
-      if (!mcts_enabled_) {
-        throw std::runtime_error(
-            std::string("MCTS method present, but no global MCTS ") +
-            "parameter file provided. Please set the mcts-params flag.");
-      }
-
-      UCTEstimator<StateIROS14, ActionIROS14>::Params uct_estimator_params;
-      uct_estimator_params.gamma = params.gamma;
-      uct_estimator_params.lambda = params.lambda;
-      uct_estimator_params.rewardBound = params.mcts_reward_bound;
-      uct_estimator_params.useImportanceSampling = false;
+    // The generators of the MCTS models hold a reference to these engines, so
+    // they need to live as long as the planner does
+    boost::mt19937 mt(2 * (seed + 1));
+    std::vector<boost::shared_ptr<boost::mt19937> > tree_mts;
 
+    if (params.type == MCTS_TYPE) {
       // Initialize the model (and random number generators)
       boost::shared_ptr<PersonModelIROS14> mcts_model(
           new PersonModelIROS14(graph, map, goal_idx, 0.0f, 
@@ -164,7 +171,6 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
             params.robot_speed, params.utility_multiplier,
             params.use_shaping_reward, params.discourage_bad_assignments));
 
-      boost::mt19937 mt(2 * (seed + 1));
       boost::uniform_int<int> i(0, boost::num_vertices(graph) - 1);
       boost::uniform_real<float> u(0.0f, 1.0f);
       boost::poisson_distribution<int> p(1);
@@ -173,19 +179,85 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
       PIGenPtr robot_goal_gen(new PIGen(mt, p));
       mcts_model->initializeRNG(idx_gen, generative_model_gen, robot_goal_gen);
 
-      // Create the RNG required for mcts rollouts
-      boost::shared_ptr<RNG> mcts_rng(new RNG(3 * (seed + 1)));
-
-      boost::shared_ptr<ModelUpdaterSingle<StateIROS14, ActionIROS14> >
-        mcts_model_updator(
-            new ModelUpdaterSingle<StateIROS14, ActionIROS14>(mcts_model));
-      boost::shared_ptr<IdentityStateMapping<StateIROS14> > mcts_state_mapping(
-          new IdentityStateMapping<StateIROS14>);
-      boost::shared_ptr<UCTEstimator<StateIROS14, ActionIROS14> > uct_estimator(
-          new UCTEstimator<StateIROS14, ActionIROS14>(mcts_rng,
-            uct_estimator_params));
-      mcts.reset(new MCTS<StateIROS14, ActionIROS14>(uct_estimator,
-            mcts_model_updator, mcts_state_mapping, mcts_params_));
+      if (params.mcts_transposition_table) {
+
+        // UCT with the search tree stored in a transposition table. Searches
+        // in 0.1s slices, same as the MCTS parameter file.
+        UCTPlannerParams uct_params;
+        uct_params.gamma = params.gamma;
+        uct_params.lambda = params.lambda;
+        uct_params.reward_bound = params.mcts_reward_bound;
+        uct_params.max_depth = params.mcts_max_depth;
+        uct_params.max_planning_time = 0.1f;
+        uct_params.equivalence = (params.mcts_exact_state_equivalence) ?
+          EXACT_STATE_EQUIVALENCE : ABSTRACT_STATE_EQUIVALENCE;
+        if (params.mcts_anytime) {
+          // Searching in the background against decision deadlines. Shorter
+          // slices only make the returned actions fresher.
+          uct_params.max_planning_time = 0.01f;
+        }
+
+        if (params.mcts_num_threads <= 1) {
+          uct.reset(new UCTPlanner<StateIROS14, ActionIROS14>(mcts_model,
+                uct_params, 3 * (seed + 1)));
+        } else {
+          // Root or tree parallel search, with one copy of the model (with
+          // its own generators) per thread
+          std::vector<boost::shared_ptr<Model<StateIROS14, ActionIROS14> > >
+            tree_models(1, mcts_model);
+          for (int t = 1; t < params.mcts_num_threads; ++t) {
+            boost::shared_ptr<PersonModelIROS14> tree_model(
+                new PersonModelIROS14(*mcts_model));
+            tree_mts.push_back(boost::shared_ptr<boost::mt19937>(
+                  new boost::mt19937(2 * (seed + 1) + 7919 * t)));
+            boost::mt19937& tree_mt = *(tree_mts.back());
+            tree_model->initializeRNG(UIGenPtr(new UIGen(tree_mt, i)),
+                URGenPtr(new URGen(tree_mt, u)), 
+                PIGenPtr(new PIGen(tree_mt, p)));
+            tree_models.push_back(tree_model);
+          }
+          if (params.mcts_tree_parallel) {
+            uct.reset(new TreeParallelUCTPlanner<StateIROS14, ActionIROS14>(
+                  tree_models, uct_params, -params.mcts_reward_bound,
+                  3 * (seed + 1)));
+          } else {
+            uct.reset(new RootParallelUCTPlanner<StateIROS14, ActionIROS14>(
+                  tree_models, uct_params, 3 * (seed + 1)));
+          }
+        }
+
+        if (params.mcts_anytime) {
+          anytime.reset(new AnytimePlanner<StateIROS14, ActionIROS14>(uct));
+        }
+
+      } else {
+
+        if (!mcts_enabled_) {
+          throw std::runtime_error(
+              std::string("MCTS method present, but no global MCTS ") +
+              "parameter file provided. Please set the mcts-params flag.");
+        }
+
+        UCTEstimator<StateIROS14, ActionIROS14>::Params uct_estimator_params;
+        uct_estimator_params.gamma = params.gamma;
+        uct_estimator_params.lambda = params.lambda;
+        uct_estimator_params.rewardBound = params.mcts_reward_bound;
+        uct_estimator_params.useImportanceSampling = false;
+
+        // Create the RNG required for mcts rollouts
+        boost::shared_ptr<RNG> mcts_rng(new RNG(3 * (seed + 1)));
+
+        boost::shared_ptr<ModelUpdaterSingle<StateIROS14, ActionIROS14> >
+          mcts_model_updator(
+              new ModelUpdaterSingle<StateIROS14, ActionIROS14>(mcts_model));
+        boost::shared_ptr<IdentityStateMapping<StateIROS14> > 
+          mcts_state_mapping(new IdentityStateMapping<StateIROS14>);
+        boost::shared_ptr<UCTEstimator<StateIROS14, ActionIROS14> > 
+          uct_estimator(new UCTEstimator<StateIROS14, ActionIROS14>(mcts_rng,
+                uct_estimator_params));
+        mcts.reset(new MCTS<StateIROS14, ActionIROS14>(uct_estimator,
+              mcts_model_updator, mcts_state_mapping, mcts_params_));
+      }
     } else if (params.type == HEURISTIC) {
       hs.reset(new HeuristicSolverIROS14(map, graph, goal_idx, 
             params.h_improved, params.human_speed));
@@ -325,14 +397,34 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
 
     method_result.mcts_terminations = 0;
     method_result.mcts_playouts = 0;
-    if (params.type == MCTS_TYPE) {
-      mcts->restart();
+    boost::system_time decision_deadline = boost::get_system_time();
+    if (anytime) {
+      // Search in the background from now on, and make the first decision
+      // once the initial planning time has passed
+      EVALUATE_OUTPUT(" - Performing initial MCTS search in the background " +
+          std::string("for ") + boost::lexical_cast<std::string>(
+            params.mcts_initial_planning_time) + "s");
+      anytime->setState(current_state, RESTART_SEARCH_TREE);
+      anytime->start();
+      decision_deadline += boost::posix_time::milliseconds(
+          static_cast<long>(1000.0f * params.mcts_initial_planning_time));
+      ActionIROS14 initial_action;
+      anytime->getAction(decision_deadline, initial_action);
+      method_result.mcts_playouts = anytime->getNumPlayouts();
+      method_result.mcts_terminations = anytime->getNumTerminations();
+    } else if (params.type == MCTS_TYPE) {
+      if (uct) {
+        uct->restart();
+      } else {
+        mcts->restart();
+      }
       EVALUATE_OUTPUT(" - Performing initial MCTS search for " +
           boost::lexical_cast<std::string>(
             params.mcts_initial_planning_time) + "s");
       for (int i = 0; i < 10 * params.mcts_initial_planning_time; ++i) {
         unsigned int playouts, terminations;
-        playouts = mcts->search(current_state, terminations);
+        playouts = (uct) ? uct->search(current_state, terminations) :
+          mcts->search(current_state, terminations);
         method_result.mcts_playouts += playouts;
         method_result.mcts_terminations += terminations;
       }
@@ -350,8 +442,18 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
       std::vector<ActionIROS14> actions;
       evaluation_model->getActionsAtState(current_state, actions);
       ActionIROS14 action;
-      if (params.type == MCTS_TYPE) {
-        action = mcts->selectWorldAction(current_state);
+      if (anytime) {
+        if (!anytime->getAction(decision_deadline, action)) {
+          EVALUATE_OUTPUT(" - No MCTS search completed by the deadline");
+          action = actions[0];
+        }
+        if (first) {
+          action = ActionIROS14(GUIDE_PERSON, start_idx, 20); 
+          first=false;
+        }
+      } else if (params.type == MCTS_TYPE) {
+        action = (uct) ? uct->selectWorldAction(current_state) :
+          mcts->selectWorldAction(current_state);
         if (first) {
           action = ActionIROS14(GUIDE_PERSON, start_idx, 20); 
           first=false;
@@ -388,11 +490,33 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
           ", Utility Lost: " << utility_loss <<
           ", Depth Count: " << depth_count);
 
+      if (anytime && action.type != WAIT) {
+        // The next decision is made from the current search tree, refined
+        // for a short time
+        anytime->setState(current_state, KEEP_SEARCH_TREE);
+        decision_deadline = boost::get_system_time() +
+          boost::posix_time::milliseconds(
+              static_cast<long>(1000.0f * params.mcts_decision_time));
+      }
+
       if (action.type == WAIT) {
         // Prune old visits before searching
-        if (params.type == MCTS_TYPE) {
-          EVALUATE_OUTPUT(" - Cleared existing MCTS search tree");
-          mcts->restart();
+        boost::system_time observation_time = boost::get_system_time();
+        if (anytime) {
+          EVALUATE_OUTPUT(" - Searching from next state in the background");
+          anytime->setState(current_state, (params.mcts_reuse_tree) ?
+              REROOT_SEARCH_TREE : RESTART_SEARCH_TREE);
+        } else if (params.type == MCTS_TYPE) {
+          if (uct && params.mcts_reuse_tree) {
+            EVALUATE_OUTPUT(" - Re-rooted MCTS search tree at next state");
+            uct->reroot(current_state);
+          } else if (uct) {
+            EVALUATE_OUTPUT(" - Cleared existing MCTS search tree");
+            uct->restart();
+          } else {
+            EVALUATE_OUTPUT(" - Cleared existing MCTS search tree");
+            mcts->restart();
+          }
         }
 
         float total_time = 0.0f;
@@ -415,11 +539,19 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
             }
             //cv::waitKey(50);
           }
-          if (params.type == MCTS_TYPE) {
+          if (anytime) {
+            // Planning time while the person walks, searched in the
+            // background until the next decision
+            total_time += 0.1f * params.mcts_planning_time_multiplier;
+          } else if (params.type == MCTS_TYPE) {
             for (int i = 0; i < params.mcts_planning_time_multiplier; ++i) {
               total_time += 0.1f;
               unsigned int terminations;
-              mcts->search(current_state, terminations);
+              if (uct) {
+                uct->search(current_state, terminations);
+              } else {
+                mcts->search(current_state, terminations);
+              }
             }
           } else {
             if (graphical_) {
@@ -428,7 +560,13 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
             }
           }
         }
-        if (params.type == MCTS_TYPE) {
+        if (anytime) {
+          decision_deadline = observation_time +
+            boost::posix_time::milliseconds(
+                static_cast<long>(1000.0f * total_time));
+          EVALUATE_OUTPUT(" - Next decision due after " << total_time << 
+              "s of MCTS search");
+        } else if (params.type == MCTS_TYPE) {
           EVALUATE_OUTPUT(" - Performed MCTS search for " << total_time << "s");
         }
       }
@@ -439,6 +577,10 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
 
     }
 
+    if (anytime) {
+      anytime->stop();
+    }
+
     // Remove the shaping reward from the result tally if it was used.
     // The evaluation model should not use this shaping reward in the first place
     // if (params.use_shaping_reward) {
@@ -1,12 +1,11 @@
 #include<fstream>
 #include<cstdlib>
 
+#include <boost/bind.hpp>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 
-#include <rl_pursuit/planning/ValueIteration.h>
-
 #include <rl_pursuit/common/Util.h>
 #include <rl_pursuit/planning/MCTS.h>
 #include <rl_pursuit/planning/UCTEstimator.h>
@@ -17,6 +16,7 @@
 #include <bwi_guidance_solver/person_estimator_qrr14.h>
 #include <bwi_guidance_solver/person_model_qrr14.h>
 #include <bwi_guidance_solver/utils.h>
+#include <bwi_guidance_solver/value_iteration_qrr14.h>
 #include <bwi_mapper/map_loader.h>
 #include <bwi_mapper/map_utils.h>
 
@@ -32,7 +32,6 @@ using namespace bwi_guidance;
 
 /* Constants */
 const std::string VI_POLICY_FILE_SUFFIX = "vi";
-const std::string MODEL_FILE_SUFFIX = "model";
 const std::string DISTANCE_FILE_SUFFIX = "distance.txt";
 const std::string REWARD_FILE_SUFFIX = "reward.txt";
 const std::string PLAYOUTS_FILE_SUFFIX = "playouts.txt";
@@ -51,6 +50,10 @@ bool allow_goal_visibility_ = false;
 MCTS<StateQRR14, ActionQRR14>::Params mcts_params_;
 bool mcts_enabled_ = false;
 int precompute_vi_ = -1;
+bool precompute_all_vi_ = false;
+bool use_model_cache_ = true;
+unsigned int vi_threads_ = 0; // Use all available cores
+ValueIterationMode vi_mode_ = SYNCHRONOUS_SWEEP;
 
 /* Structures used to define a single method */
 const std::string METHOD_TYPE_NAMES[3] = {
@@ -110,9 +113,10 @@ struct InstanceResult {
 //   return stream;
 // }
 
-std::string getIndexedModelFile(int goal_idx) {
-  return data_directory_ +
-    boost::lexical_cast<std::string>(goal_idx) + "_" + MODEL_FILE_SUFFIX;
+std::string getModelFile(float pixel_visibility_range) {
+  // The model cache is shared between all goals
+  return getModelCacheFileQRR14(data_directory_, allow_robot_current_idx_, 
+      pixel_visibility_range, allow_goal_visibility_);
 }
 
 std::string getIndexedVIFile(int goal_idx, const Method::Params& params) {
@@ -127,18 +131,18 @@ std::string getIndexedVIFile(int goal_idx, const Method::Params& params) {
 boost::shared_ptr<PersonModelQRR14> getModel(bwi_mapper::Graph& graph,
     nav_msgs::OccupancyGrid& map, int goal_idx) {
 
-  //std::string indexed_model_file = getIndexedModelFile(goal_idx);
-  std::string indexed_model_file; // Do not load or save models to file
   float pixel_visibility_range = visibility_range_ / map.info.resolution;
+  std::string model_file = 
+    (use_model_cache_) ? getModelFile(pixel_visibility_range) : "";
 
   boost::shared_ptr<PersonModelQRR14> model(
-      new PersonModelQRR14(graph, map, goal_idx, indexed_model_file, 
+      new PersonModelQRR14(graph, map, goal_idx, model_file, 
         allow_robot_current_idx_, pixel_visibility_range,
         allow_goal_visibility_));
   return model;
 }
 
-boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > getVIInstance(
+boost::shared_ptr<ValueIterationQRR14> getVIInstance(
     nav_msgs::OccupancyGrid& map,
     const boost::shared_ptr<PersonModelQRR14>& model, 
     const boost::shared_ptr<PersonEstimatorQRR14>& estimator, int goal_idx, 
@@ -148,10 +152,10 @@ boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > getVIInstance(
   float delta = -500.0f / map.info.resolution; // lower value bound for VI
   int num_iterations = 1000;
 
-  boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > vi(
-      new ValueIteration<StateQRR14, ActionQRR14>(model, estimator, 
-        params.gamma, epsilon, num_iterations, 
-        std::numeric_limits<float>::max(), delta));
+  boost::shared_ptr<ValueIterationQRR14> vi(
+      new ValueIterationQRR14(model, estimator, params.gamma, epsilon,
+        num_iterations, std::numeric_limits<float>::max(), delta,
+        vi_threads_, vi_mode_));
 
   std::string indexed_vi_file = getIndexedVIFile(goal_idx, params);
   std::ifstream vi_ifs(indexed_vi_file.c_str());
@@ -164,7 +168,8 @@ boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > getVIInstance(
     vi->computePolicy();
     vi->savePolicy(indexed_vi_file);
     EVALUATE_OUTPUT("Computed and saved policy for " << goal_idx << " to file: " 
-      << indexed_vi_file);
+      << indexed_vi_file << " (" << vi->getNumBackups() << " backups, " <<
+      vi->getNumSweeps() << " sweeps)");
   }
   vi_ifs.close();
 
@@ -192,12 +197,52 @@ float getRewardNormalizationValue(
 
 /* Top level execution functions */
 
+void savePrecomputedPolicy(const boost::shared_ptr<ValueIterationQRR14>& vi,
+    const Method::Params& params) {
+  int goal_idx = vi->getModel()->getGoalIdx();
+  std::string indexed_vi_file = getIndexedVIFile(goal_idx, params);
+  vi->savePolicy(indexed_vi_file);
+  EVALUATE_OUTPUT("Computed and saved policy for " << goal_idx << " to file: " 
+    << indexed_vi_file << " (" << vi->getNumBackups() << " backups, " <<
+    vi->getNumSweeps() << " sweeps)");
+}
+
 void precomputeVI(bwi_mapper::Graph& graph, nav_msgs::OccupancyGrid& map,
-    int goal_idx, const Method::Params& params) {
-  EVALUATE_OUTPUT("Precomputing policy for goal " << goal_idx << params);
-  boost::shared_ptr<PersonModelQRR14> model = getModel(graph, map, goal_idx);
-  boost::shared_ptr<PersonEstimatorQRR14> estimator(new PersonEstimatorQRR14);
-  getVIInstance(map, model, estimator, goal_idx, params);
+    const std::vector<int>& goals, const Method::Params& params) {
+
+  // Policies already present on disk do not need to be recomputed
+  std::vector<int> remaining_goals;
+  BOOST_FOREACH(int goal_idx, goals) {
+    std::string indexed_vi_file = getIndexedVIFile(goal_idx, params);
+    std::ifstream vi_ifs(indexed_vi_file.c_str());
+    if (vi_ifs.good()) {
+      EVALUATE_OUTPUT("VI policy found from file: " << indexed_vi_file);
+    } else {
+      remaining_goals.push_back(goal_idx);
+    }
+  }
+  if (remaining_goals.empty()) {
+    return;
+  }
+
+  EVALUATE_OUTPUT("Precomputing policies for " << remaining_goals.size() <<
+      " goals" << params);
+
+  // The model is built once, and shared between all goals
+  boost::shared_ptr<PersonModelQRR14> model = 
+    getModel(graph, map, remaining_goals[0]);
+  model->updateRewardStructure(params.success_reward, 
+      (RewardStructure) params.reward_structure,
+      params.mcts_importance_sampling);
+
+  float epsilon = 0.05f / map.info.resolution; // stop VI if maxchange < epsilon
+  float delta = -500.0f / map.info.resolution; // lower value bound for VI
+  int num_iterations = 1000;
+
+  computePoliciesForGoals(model, remaining_goals, 
+      boost::bind(&savePrecomputedPolicy, _1, boost::cref(params)),
+      params.gamma, epsilon, num_iterations, 
+      std::numeric_limits<float>::max(), delta, vi_threads_, vi_mode_);
 }
 
 InstanceResult testInstance(int seed, bwi_mapper::Graph& graph, 
@@ -218,7 +263,7 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
     MethodResult method_result;
 
     boost::shared_ptr<HeuristicSolver> hs;
-    boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > vi;
+    boost::shared_ptr<ValueIterationQRR14> vi;
     boost::shared_ptr<MCTS<StateQRR14, ActionQRR14> > mcts;
 
     const Method::Params& params = methods[method];
@@ -231,7 +276,7 @@ InstanceResult testInstance(int seed, bwi_mapper::Graph& graph,
             allow_robot_current_idx_, pixel_visibility_range,
             allow_goal_visibility_)); 
     } else if (params.type == VI) {
-      estimator.reset(new PersonEstimatorQRR14);
+      estimator.reset(new PersonEstimatorQRR14(model));
       vi = getVIInstance(map, model, estimator, goal_idx, params);
     } else if (params.type == MCTS_TYPE) {
 
@@ -441,6 +486,10 @@ int processOptions(int argc, char** argv) {
     ("seed_", po::value<int>(&seed_), "Random seed (process number on condor)")  
     ("num-instances", po::value<int>(&num_instances_), "Number of Instances") 
     ("precompute-vi", po::value<int>(&precompute_vi_), "Precompute VI based on parameters provided in methods file. The parameters are read from the first VI instance") 
+    ("precompute-all-vi", "Precompute VI (as in precompute-vi) for every vertex in the graph") 
+    ("no-model-cache", "Do not load or save the model cache in the data directory") 
+    ("vi-threads", po::value<unsigned int>(&vi_threads_), "Number of threads used while computing VI (0 uses all available cores)") 
+    ("vi-prioritized-sweeping", "Compute VI using goal-ordered prioritized sweeping instead of synchronous sweeps") 
     ("visibility-range", po::value<float>(&visibility_range_), 
      "Simulator visibility range in meters.")
     ("distance-limit", po::value<float>(&distance_limit_), 
@@ -469,6 +518,15 @@ int processOptions(int argc, char** argv) {
   if (vm.count("allow-robot-current")) {
     allow_robot_current_idx_ = true;
   }
+  if (vm.count("no-model-cache")) {
+    use_model_cache_ = false;
+  }
+  if (vm.count("precompute-all-vi")) {
+    precompute_all_vi_ = true;
+  }
+  if (vm.count("vi-prioritized-sweeping")) {
+    vi_mode_ = PRIORITIZED_SWEEP;
+  }
   if (vm.count("allow-goal-visibility")) {
     allow_goal_visibility_ = true;
   }
@@ -528,25 +586,33 @@ int main(int argc, char** argv) {
   mapper.getMap(map);
   bwi_mapper::readGraphFromFile(graph_file_, map.info, graph);
 
-  if (precompute_vi_ != -1) {
+  if (precompute_vi_ != -1 || precompute_all_vi_) {
 
     // Make sure correct graph id provided
     int num_vertices = boost::num_vertices(graph);
-    if (precompute_vi_ < 0 || precompute_vi_ >= num_vertices) {
+    if (!precompute_all_vi_ && 
+        (precompute_vi_ < 0 || precompute_vi_ >= num_vertices)) {
         throw std::runtime_error(
             std::string("The value of precompute_vi_ should be between 0 and ") 
             + boost::lexical_cast<std::string>(num_vertices));
     }
 
-    // We are simply initializing the specified VI instance
-    // Locate the first vi instance in specified methods
+    // We are simply initializing the specified VI instances
+    std::vector<int> goals;
+    if (precompute_all_vi_) {
+      for (int i = 0; i < num_vertices; ++i) {
+        goals.push_back(i);
+      }
+    } else {
+      for (int i = precompute_vi_; i < precompute_vi_ + num_instances_; ++i) {
+        goals.push_back(i);
+      }
+    }
     int count = 0;
     BOOST_FOREACH(const Method::Params& params, methods_) {
       if (params.type == VI) {
-        for (int i = precompute_vi_; i < precompute_vi_ + num_instances_; ++i) {
-          precomputeVI(graph, map, i, params);
-          ++count;
-        }
+        precomputeVI(graph, map, goals, params);
+        count += goals.size();
       }
     }
 
@@ -1,31 +1,64 @@
 #include<fstream>
 
-#include <rl_pursuit/planning/ValueIteration.h>
 #include <bwi_guidance_solver/person_estimator_qrr14.h>
 #include <bwi_guidance_solver/person_model_qrr14.h>
 #include <bwi_guidance_solver/heuristic_solver_qrr14.h>
+#include <bwi_guidance_solver/value_iteration_qrr14.h>
 #include <bwi_mapper/map_loader.h>
 #include <bwi_guidance/base_robot_positioner.h>
+#include <bwi_guidance/graph_tracker.h>
+#include <bwi_guidance/observation_queue.h>
 #include <tf/transform_datatypes.h>
 #include <boost/foreach.hpp>
 
 using namespace bwi_guidance;
 
+/* Person location (in grid coordinates) received for an instance */
+struct PersonObservation {
+  bwi_mapper::Point2f loc;
+  unsigned int instance;
+};
+
+struct RobotPlacement {
+  size_t robot_idx;
+  int graph_id;
+  geometry_msgs::Pose pose;
+};
+
+struct RobotDirection {
+  size_t robot_idx;
+  float yaw;
+  cv::Mat image;
+};
+
+/* Everything that changes when the person reaches start_state */
+struct PlacementPlan {
+  StateQRR14 start_state;
+  std::vector<StateQRR14> transitions; // automatic, after start_state
+  std::vector<RobotPlacement> placements;
+  std::vector<RobotDirection> directions;
+  size_t assigned_robots;
+  bwi_mapper::Point2f assigned_robot_loc;
+  float assigned_robot_yaw;
+};
+
 class RobotPositionerQRR14 : public BaseRobotPositioner {
 
   private:
     boost::shared_ptr<PersonModelQRR14> model_;
     boost::shared_ptr<PersonEstimatorQRR14> estimator_;
-    boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > vi_;
+    boost::shared_ptr<ValueIterationQRR14> vi_;
     boost::shared_ptr<HeuristicSolver> hs_;
 
     std::map<int, boost::shared_ptr<PersonModelQRR14> > model_map_;
     std::map<int, boost::shared_ptr<PersonEstimatorQRR14> > estimator_map_;
-    std::map<int, boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > > vi_map_;
+    std::map<int, boost::shared_ptr<ValueIterationQRR14> > vi_map_;
     std::map<int, boost::shared_ptr<HeuristicSolver> > hs_map_;
 
     double vi_gamma_;
     int vi_max_iterations_;
+    int vi_threads_;
+    bool vi_prioritized_sweeping_;
     std::string data_directory_;
     bool use_heuristic_;
     bool allow_robot_current_idx_;
@@ -41,20 +74,59 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
     float assigned_robot_yaw_;
     std::map<int, int> graph_id_to_robot_map_;
 
+    // Follows the person along the graph between observations
+    boost::shared_ptr<GraphTracker> tracker_;
+    std::vector<size_t> reached_vertices_;
+
+    // Odometry callbacks only queue observations. Graph snapping, state
+    // transitions and robot placement happen on the planning thread, which
+    // holds planning_mutex_ while it uses the instance state above.
+    ObservationQueue<PersonObservation> observations_;
+    boost::shared_ptr<boost::thread> planning_thread_;
+    boost::mutex planning_mutex_;
+    boost::mutex observation_wait_mutex_;
+    boost::condition_variable observation_available_;
+    bool stop_planning_; // under observation_wait_mutex_
+    bool speculation_requested_; // under observation_wait_mutex_
+    volatile unsigned int instance_count_;
+    bool planning_enabled_; // instance in progress, for the planning thread
+
+    // Placement plans for the next states of current_state_ (by graph id),
+    // computed by the planning thread while it has no observations to
+    // process. Only valid until the next plan is committed.
+    std::map<int, PlacementPlan> speculative_plans_;
+    bool speculation_pending_;
+
   public:
 
     RobotPositionerQRR14(boost::shared_ptr<ros::NodeHandle>& nh) :
-        BaseRobotPositioner(nh) {
+        BaseRobotPositioner(nh), observations_(256), stop_planning_(false),
+        speculation_requested_(false),
+        instance_count_(0), planning_enabled_(false), 
+        speculation_pending_(false) {
 
       ros::NodeHandle private_nh("~");
       private_nh.param<std::string>("data_directory", data_directory_, "");
       private_nh.param<double>("vi_gamma", vi_gamma_, 1.0);
       private_nh.param<int>("vi_max_iterations", vi_max_iterations_, 1000);
+      private_nh.param<int>("vi_threads", vi_threads_, 0);
+      private_nh.param<bool>("vi_prioritized_sweeping", 
+          vi_prioritized_sweeping_, false);
       private_nh.param<bool>("use_heuristic", use_heuristic_, false);
       private_nh.param<bool>("allow_robot_current", allow_robot_current_idx_, 
           false);
       private_nh.param<bool>("allow_goal_visibility", allow_goal_visibility_, 
           true);
+
+      // Distances on the graph are in map pixels
+      double tracking_hysteresis, relocalize_distance;
+      private_nh.param<double>("tracking_hysteresis", tracking_hysteresis, 
+          0.5);
+      private_nh.param<double>("tracking_relocalize_distance", 
+          relocalize_distance, 3.0);
+      tracker_.reset(new GraphTracker(*graph_index_, 
+            tracking_hysteresis / map_info_.resolution,
+            relocalize_distance / map_info_.resolution));
       private_nh.param<double>("visibility_range", visibility_range_, 
           30.0);
 
@@ -67,7 +139,10 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
       ROS_INFO_STREAM("Simulator visibility: " << visibility_range_);
       ROS_INFO_STREAM("Allor visibility of goal: " << allow_goal_visibility_);
 
-      // Pre-compute all the experiment related information
+      // Pre-compute all the experiment related information. The goal 
+      // independent parts of the model are only computed once, and shared
+      // between the models for all goals.
+      boost::shared_ptr<PersonModelQRR14> base_model;
       std::vector<std::string> instance_names;
       getInstanceNames(experiment_, instance_names);
       BOOST_FOREACH(const std::string iname, instance_names) {
@@ -75,31 +150,40 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
         bwi_mapper::Point2f goal_point(instance.ball_loc.x,
             instance.ball_loc.y);
         goal_point = bwi_mapper::toGrid(goal_point, map_info_);
-        int goal_idx = 
-          bwi_mapper::getClosestIdOnGraph(goal_point, graph_);
+        int goal_idx = graph_index_->getClosestVertex(goal_point);
 
-        // Compute model file
-        std::string model_file = ""; //Saving/Loading Model files disabled
-        // std::string model_file = data_directory_
-        //   + boost::lexical_cast<std::string>(goal_idx) + "_model.txt";
+        // The model cache is shared between all goals
+        float pixel_visibility_range = visibility_range_ / map_.info.resolution;
+        std::string model_file = getModelCacheFileQRR14(data_directory_,
+            allow_robot_current_idx_, pixel_visibility_range,
+            allow_goal_visibility_);
+        // Policies are saved in the flat format, which can be memory mapped.
+        // Policies in the estimator's format are still loaded if present.
         std::string vi_file = data_directory_
+          + boost::lexical_cast<std::string>(goal_idx) + "_vi.bin";
+        std::string legacy_vi_file = data_directory_
           + boost::lexical_cast<std::string>(goal_idx) + "_vi.txt";
 
         // Setup the model and the heuristic solver to read from file
         boost::shared_ptr<PersonModelQRR14> model;
         boost::shared_ptr<PersonEstimatorQRR14> estimator;
-        boost::shared_ptr<ValueIteration<StateQRR14, ActionQRR14> > vi;
+        boost::shared_ptr<ValueIterationQRR14> vi;
         boost::shared_ptr<HeuristicSolver> hs;
-        float pixel_visibility_range = visibility_range_ / map_.info.resolution;
-        model.reset(new PersonModelQRR14(graph_, map_, goal_idx, model_file,
-              allow_robot_current_idx_, pixel_visibility_range,
-              allow_goal_visibility_));
-        estimator.reset(new PersonEstimatorQRR14);
+        if (base_model) {
+          model.reset(new PersonModelQRR14(*base_model, goal_idx));
+        } else {
+          model.reset(new PersonModelQRR14(graph_, map_, goal_idx, model_file,
+                allow_robot_current_idx_, pixel_visibility_range,
+                allow_goal_visibility_));
+          base_model = model;
+        }
+        estimator.reset(new PersonEstimatorQRR14(model));
         float epsilon = 0.05f / map_.info.resolution;
         float delta = -500.0f / map_.info.resolution;
-        vi.reset(new ValueIteration<StateQRR14, ActionQRR14>(
+        vi.reset(new ValueIterationQRR14(
               model, estimator, vi_gamma_, epsilon, vi_max_iterations_,
-              0.0, delta));
+              0.0, delta, vi_threads_, (vi_prioritized_sweeping_ ?
+                PRIORITIZED_SWEEP : SYNCHRONOUS_SWEEP)));
         hs.reset(new HeuristicSolver(map_, graph_, goal_idx,
               allow_robot_current_idx_, pixel_visibility_range, 
               allow_goal_visibility_)); 
@@ -108,6 +192,12 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
         std::ifstream fin(vi_file.c_str());
         if (fin.good()) {
           policy_available = true;
+        } else {
+          std::ifstream legacy_fin(legacy_vi_file.c_str());
+          if (legacy_fin.good()) {
+            policy_available = true;
+            vi_file = legacy_vi_file;
+          }
         }
         if (policy_available) {
           vi->loadPolicy(vi_file);
@@ -117,7 +207,10 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
           ROS_INFO_STREAM("RobotPositionerQRR14: Computing policy for goal_idx: "
               << goal_idx);
           vi->computePolicy();
-          vi->savePolicy(vi_file);
+          ROS_INFO_STREAM("RobotPositionerQRR14: Policy computed using " <<
+              vi->getNumBackups() << " backups (" << vi->getNumSweeps() << 
+              " sweeps)");
+          vi->saveFlatPolicy(vi_file);
           ROS_INFO_STREAM("RobotPositionerQRR14: Saved policy to " << vi_file);
         }
 
@@ -127,13 +220,27 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
         hs_map_[goal_idx] = hs;
       }
 
+      planning_thread_.reset(new boost::thread(
+            boost::bind(&RobotPositionerQRR14::runPlanning, this)));
     }
 
-    virtual ~RobotPositionerQRR14() {}
+    virtual ~RobotPositionerQRR14() {
+      {
+        boost::mutex::scoped_lock lock(observation_wait_mutex_);
+        stop_planning_ = true;
+        observation_available_.notify_one();
+      }
+      planning_thread_->join();
+    }
 
     virtual void startExperimentInstance(
         const std::string& instance_name) {
 
+      // Observations still queued for the previous instance are discarded
+      boost::mutex::scoped_lock planning_lock(planning_mutex_);
+      ++instance_count_;
+      speculative_plans_.clear();
+
       instance_name_ = instance_name;
       assigned_robots_ = 0;
 
@@ -142,14 +249,12 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
       bwi_mapper::Point2f start_point(instance.start_loc.x,
           instance.start_loc.y);
       start_point = bwi_mapper::toGrid(start_point, map_info_);
-      size_t start_idx = 
-        bwi_mapper::getClosestIdOnGraph(start_point, graph_);
+      size_t start_idx = graph_index_->getClosestVertex(start_point);
 
       bwi_mapper::Point2f goal_point(instance.ball_loc.x,
           instance.ball_loc.y);
       goal_point = bwi_mapper::toGrid(goal_point, map_info_);
-      goal_idx_ = 
-        bwi_mapper::getClosestIdOnGraph(goal_point, graph_);
+      goal_idx_ = graph_index_->getClosestVertex(goal_point);
  
       model_ = model_map_[goal_idx_];
       estimator_ = estimator_map_[goal_idx_];
@@ -160,53 +265,95 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
         getDiscretizedAngle(instance.start_loc.yaw);
 
       current_state_.graph_id = start_idx;
+      tracker_->reset(start_idx);
       current_state_.direction = direction;
       current_state_.num_robots_left = instance.max_robots;
       current_state_.robot_direction = NONE;
       current_state_.visible_robot = NONE;
       ROS_INFO_STREAM("Start at: " << current_state_);
       checkRobotPlacementAtCurrentState();
+      planning_enabled_ = true;
+
+      // Start speculating before the first observation arrives
+      boost::mutex::scoped_lock lock(observation_wait_mutex_);
+      speculation_requested_ = true;
+      observation_available_.notify_one();
+    }
+
+    /* The planning thread is stopped from acting on the instance before the
+     * robots are sent back, so that a transition being processed cannot
+     * place them again */
+    virtual void finalizeExperimentInstance() {
+      boost::mutex::scoped_lock planning_lock(planning_mutex_);
+      ++instance_count_;
+      planning_enabled_ = false;
+      speculative_plans_.clear();
+      speculation_pending_ = false;
+      BaseRobotPositioner::finalizeExperimentInstance();
     }
 
+    /* Uses the placement plan speculatively computed for the current state
+     * if there is one */
     virtual void checkRobotPlacementAtCurrentState() {
 
-      boost::mutex::scoped_lock lock(robot_modification_mutex_);
+      PlacementPlan plan;
+      std::map<int, PlacementPlan>::iterator speculative_plan =
+        speculative_plans_.find(current_state_.graph_id);
+      if (speculative_plan != speculative_plans_.end() &&
+          speculative_plan->second.start_state == current_state_) {
+        plan = speculative_plan->second;
+      } else {
+        computePlacementPlan(current_state_, plan);
+      }
+      commitPlacementPlan(plan);
+    }
 
-      const Instance& instance = 
-        getInstance(experiment_, instance_name_);
+    /* Follows the policy from state until it does nothing, and records the
+     * robot placements and directions along the way. Only reads the
+     * positioner state, so it can be computed ahead of time. */
+    void computePlacementPlan(const StateQRR14& state, PlacementPlan& plan) {
+
+      plan.start_state = state;
+      plan.transitions.clear();
+      plan.placements.clear();
+      plan.directions.clear();
+      plan.assigned_robots = assigned_robots_;
+      plan.assigned_robot_loc = assigned_robot_loc_;
+      plan.assigned_robot_yaw = assigned_robot_yaw_;
 
       // First check if we need to place a robot according to VI policy
+      StateQRR14 current_state = state;
       ActionQRR14 action;
       if (use_heuristic_) {
-        action = hs_->getBestAction(current_state_);
+        action = hs_->getBestAction(current_state);
       } else {
-        action = vi_->getBestAction(current_state_);
+        action = vi_->getBestAction(current_state);
       }
       std::vector<StateQRR14> next_states;
       std::vector<float> probabilities;
       std::vector<float> rewards;
-      model_->getTransitionDynamics(current_state_, action, next_states, 
+      model_->getTransitionDynamics(current_state, action, next_states, 
           rewards, probabilities);
 
       while (action.type != DO_NOTHING) {
-        current_state_ = next_states[0];
-        ROS_INFO_STREAM("AUTO transition to: " << current_state_);
+        current_state = next_states[0];
+        plan.transitions.push_back(current_state);
         if (action.type == DIRECT_PERSON) {
 
           // Figure out direction to point towards here
           bwi_mapper::Point2f to_loc = 
             bwi_mapper::getLocationFromGraphId(
-                current_state_.robot_direction, graph_);
-          bwi_mapper::Point2f change_loc = to_loc - assigned_robot_loc_;
+                current_state.robot_direction, graph_);
+          bwi_mapper::Point2f change_loc = to_loc - plan.assigned_robot_loc;
           float destination_yaw = atan2(change_loc.y, change_loc.x);
-          float change_in_yaw = destination_yaw - assigned_robot_yaw_;
-          cv::Mat robot_image;
-          produceDirectedArrow(change_in_yaw, robot_image);
+          float change_in_yaw = destination_yaw - plan.assigned_robot_yaw;
 
-          // Teleport the robot and assign a direction
-          std::string robot_id = default_robots_.robots[assigned_robots_ - 1].id;
-          robot_screen_orientations_[robot_id] = destination_yaw;
-          robot_screen_publisher_.updateImage(robot_id, robot_image);
+          // Assign a direction to the last robot placed
+          RobotDirection direction;
+          direction.robot_idx = plan.assigned_robots - 1;
+          direction.yaw = destination_yaw;
+          produceDirectedArrow(change_in_yaw, direction.image);
+          plan.directions.push_back(direction);
 
         } else {
 
@@ -214,11 +361,11 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
           // around the node
           bwi_mapper::Point2f at_loc = 
             bwi_mapper::getLocationFromGraphId(
-                current_state_.visible_robot, graph_);
+                current_state.visible_robot, graph_);
 
           float angle = bwi_mapper::getNodeAngle(
-                current_state_.graph_id, 
-                current_state_.visible_robot, graph_
+                current_state.graph_id, 
+                current_state.visible_robot, graph_
                 );
           bwi_mapper::Point2f from_loc =
             at_loc - bwi_mapper::Point2f(
@@ -228,9 +375,9 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
           // Perform lookahead to see best location to place robot
           size_t direction_idx = getDiscretizedAngle(angle);
           StateQRR14 robot_state;
-          robot_state.graph_id = current_state_.visible_robot;
+          robot_state.graph_id = current_state.visible_robot;
           robot_state.direction = direction_idx;
-          robot_state.num_robots_left = current_state_.num_robots_left;
+          robot_state.num_robots_left = current_state.num_robots_left;
           robot_state.robot_direction = DIR_UNASSIGNED;
           robot_state.visible_robot = NONE;
           ActionQRR14 robot_action;
@@ -244,44 +391,173 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
                 robot_action.graph_id, graph_);
 
           // Compute robot pose
-          geometry_msgs::Pose pose = positionRobot(from_loc, at_loc, to_loc);
-          assigned_robot_yaw_ = tf::getYaw(pose.orientation);
-          assigned_robot_loc_ = 
-            bwi_mapper::Point2f(pose.position.x, pose.position.y);
-          assigned_robot_loc_ = 
-            bwi_mapper::toGrid(assigned_robot_loc_, map_info_);
-
-          // Teleport the robot and forward this information
-          std::string robot_id = default_robots_.robots[assigned_robots_].id;
-          robot_locations_[robot_id] = pose;
-          graph_id_to_robot_map_[current_state_.visible_robot] =
-            assigned_robots_;
-
-          ++assigned_robots_;
+          RobotPlacement placement;
+          placement.robot_idx = plan.assigned_robots;
+          placement.graph_id = current_state.visible_robot;
+          placement.pose = positionRobot(from_loc, at_loc, to_loc);
+          plan.placements.push_back(placement);
+          plan.assigned_robot_yaw = tf::getYaw(placement.pose.orientation);
+          plan.assigned_robot_loc = bwi_mapper::Point2f(
+              placement.pose.position.x, placement.pose.position.y);
+          plan.assigned_robot_loc = 
+            bwi_mapper::toGrid(plan.assigned_robot_loc, map_info_);
+
+          ++plan.assigned_robots;
         }
         if (use_heuristic_) {
-          action = hs_->getBestAction(current_state_);
+          action = hs_->getBestAction(current_state);
         } else {
-          action = vi_->getBestAction(current_state_);
+          action = vi_->getBestAction(current_state);
         }
-        model_->getTransitionDynamics(current_state_, action, next_states, 
+        model_->getTransitionDynamics(current_state, action, next_states, 
             rewards, probabilities);
       }
     }
 
+    /* Teleports the robots and assigns the directions of plan, which must
+     * have been computed for the current state. Speculative plans are
+     * computed against the robots assigned so far, so they are discarded. */
+    void commitPlacementPlan(const PlacementPlan& plan) {
+
+      boost::mutex::scoped_lock lock(robot_modification_mutex_);
+
+      BOOST_FOREACH(const StateQRR14& state, plan.transitions) {
+        ROS_INFO_STREAM("AUTO transition to: " << state);
+      }
+      BOOST_FOREACH(const RobotPlacement& placement, plan.placements) {
+        std::string robot_id = 
+          default_robots_.robots[placement.robot_idx].id;
+        setRobotLocation(robot_id, placement.pose);
+        graph_id_to_robot_map_[placement.graph_id] = placement.robot_idx;
+      }
+      BOOST_FOREACH(const RobotDirection& direction, plan.directions) {
+        std::string robot_id = 
+          default_robots_.robots[direction.robot_idx].id;
+        setRobotScreenOrientation(robot_id, direction.yaw);
+        robot_screen_publisher_.updateImage(robot_id, direction.image);
+      }
+      if (!plan.transitions.empty()) {
+        current_state_ = plan.transitions.back();
+      }
+      assigned_robots_ = plan.assigned_robots;
+      assigned_robot_loc_ = plan.assigned_robot_loc;
+      assigned_robot_yaw_ = plan.assigned_robot_yaw;
+
+      speculative_plans_.clear();
+      speculation_pending_ = true;
+    }
+
+    /* Computes the placement plan for one of the states the person can
+     * transition to next, while they are still walking towards it. The
+     * state at the end of the edge the person is tracked on comes first, as
+     * it is the likeliest to be needed soon. Returns false once all of them
+     * have a plan. */
+    bool speculateNextPlacement() {
+
+      if (!speculation_pending_) {
+        return false;
+      }
+      ActionQRR14 a(DO_NOTHING, 0);
+      std::vector<StateQRR14> next_states; 
+      model_->getNextStates(current_state_, a, next_states); 
+      const StateQRR14* next_state = NULL;
+      BOOST_FOREACH(const StateQRR14& state, next_states) {
+        if (speculative_plans_.find(state.graph_id) == 
+            speculative_plans_.end()) {
+          if (next_state == NULL || 
+              state.graph_id == (int)tracker_->getNextVertex()) {
+            next_state = &state;
+          }
+        }
+      }
+      if (next_state == NULL) {
+        speculation_pending_ = false;
+        return false;
+      }
+      computePlacementPlan(*next_state, 
+          speculative_plans_[next_state->graph_id]);
+      return true;
+    }
+
+    /* Never blocks: only hands the observation to the planning thread */
     virtual void odometryCallback(const nav_msgs::Odometry::ConstPtr odom) {
       
       if (!instance_in_progress_)
         return;
 
-      bwi_mapper::Point2f person_loc(
+      PersonObservation observation;
+      observation.loc = bwi_mapper::Point2f(
           odom->pose.pose.position.x,
           odom->pose.pose.position.y);
-      person_loc = bwi_mapper::toGrid(person_loc, map_info_);
+      observation.loc = bwi_mapper::toGrid(observation.loc, map_info_);
+      observation.instance = instance_count_;
+      if (!observations_.push(observation)) {
+        ROS_WARN_STREAM_THROTTLE(1.0, "RobotPositionerQRR14: planning " <<
+            "thread is falling behind, dropping person observations");
+        return;
+      }
+      boost::mutex::scoped_lock lock(observation_wait_mutex_);
+      observation_available_.notify_one();
+    }
+
+    void runPlanning() {
+      while (ros::ok()) {
+        {
+          boost::mutex::scoped_lock lock(observation_wait_mutex_);
+          if (stop_planning_) {
+            return;
+          }
+        }
+        PersonObservation observation;
+        if (observations_.pop(observation)) {
+          boost::mutex::scoped_lock planning_lock(planning_mutex_);
+          if (observation.instance == instance_count_ && 
+              planning_enabled_) {
+            processPersonLocation(observation.loc);
+          }
+          continue;
+        }
+
+        // Use the time until the next observation to prepare for the next
+        // transition, one state at a time
+        bool speculated = false;
+        {
+          boost::mutex::scoped_lock planning_lock(planning_mutex_);
+          if (planning_enabled_) {
+            speculated = speculateNextPlacement();
+          }
+        }
+        if (!speculated) {
+          // The callback notifies under the same lock, so an observation
+          // pushed after this check always wakes the thread up
+          boost::mutex::scoped_lock lock(observation_wait_mutex_);
+          while (!stop_planning_ && !speculation_requested_ &&
+              observations_.empty()) {
+            observation_available_.wait(lock);
+          }
+          speculation_requested_ = false;
+        }
+      }
+    }
+
+    void processPersonLocation(const bwi_mapper::Point2f& person_loc) {
+
+      reached_vertices_.clear();
+      if (!tracker_->update(person_loc, reached_vertices_)) {
+        return;
+      }
+      BOOST_FOREACH(size_t vertex, reached_vertices_) {
+        processTransition(vertex);
+      }
+
+      // Transitions that are not possible from the current state are 
+      // discarded, and are attempted again with the next observation
+      if (tracker_->getCurrentVertex() != current_state_.graph_id) {
+        tracker_->reset(current_state_.graph_id);
+      }
+    }
 
-      size_t current_graph_id =
-        bwi_mapper::getClosestIdOnGraphFromEdge(person_loc,
-            graph_, current_state_.graph_id);
+    void processTransition(size_t current_graph_id) {
 
       if (current_graph_id != current_state_.graph_id) {
         // A transition has happened. Compute next state and check if robot 
@@ -296,11 +572,11 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
             graph_id_to_robot_map_[current_state_.graph_id];
           std::string old_robot_id = 
             default_robots_.robots[robot_number].id;
-          robot_locations_[old_robot_id] = 
-            convert2dToPose(
+          setRobotLocation(old_robot_id,
+              convert2dToPose(
                 default_robots_.robots[robot_number].default_loc.x,
                 default_robots_.robots[robot_number].default_loc.y,
-                0);
+                0));
         }
 
         BOOST_FOREACH(const StateQRR14& state, next_states) {
@@ -310,15 +586,16 @@ class RobotPositionerQRR14 : public BaseRobotPositioner {
             if (old_robot_state != NONE && 
                 current_state_.visible_robot == NONE &&
                 current_state_.robot_direction == NONE) {
+              boost::mutex::scoped_lock lock(robot_modification_mutex_);
               int robot_number = 
                 graph_id_to_robot_map_[old_robot_state];
               std::string old_robot_id = 
                 default_robots_.robots[robot_number].id;
-              robot_locations_[old_robot_id] = 
-                convert2dToPose(
+              setRobotLocation(old_robot_id,
+                  convert2dToPose(
                     default_robots_.robots[robot_number].default_loc.x,
                     default_robots_.robots[robot_number].default_loc.y,
-                    0);
+                    0));
             }
             ROS_INFO_STREAM("MANUAL transition to: " << current_state_);
             checkRobotPlacementAtCurrentState();
@@ -0,0 +1,144 @@
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+
+#include <bwi_guidance_solver/person_model_iros14.h>
+#include <bwi_guidance_solver/root_parallel_uct_planner.h>
+#include <bwi_guidance_solver/tree_parallel_uct_planner.h>
+#include <bwi_mapper/map_loader.h>
+
+using namespace bwi_guidance;
+
+/* Reports UCT playouts per second for an increasing number of threads, for
+ * both the tree parallel and the root parallel planners */
+
+std::string map_file = "";
+std::string graph_file = "";
+int start_idx = 0;
+int goal_idx = 1;
+int max_threads = 0;
+float planning_time = 5.0f;
+float reward_bound = 250.0f;
+
+boost::shared_ptr<SearchPlanner<StateIROS14, ActionIROS14> > createPlanner(
+    bool tree_parallel, unsigned int num_threads,
+    const boost::shared_ptr<PersonModelIROS14>& base_model,
+    std::vector<boost::shared_ptr<boost::mt19937> >& mts,
+    bwi_mapper::Graph& graph) {
+
+  boost::uniform_int<int> i(0, boost::num_vertices(graph) - 1);
+  boost::uniform_real<float> u(0.0f, 1.0f);
+  boost::poisson_distribution<int> p(1);
+
+  std::vector<boost::shared_ptr<Model<StateIROS14, ActionIROS14> > > models;
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    boost::shared_ptr<PersonModelIROS14> model(
+        new PersonModelIROS14(*base_model));
+    mts.push_back(boost::shared_ptr<boost::mt19937>(new boost::mt19937(t)));
+    boost::mt19937& mt = *(mts.back());
+    model->initializeRNG(UIGenPtr(new UIGen(mt, i)),
+        URGenPtr(new URGen(mt, u)), PIGenPtr(new PIGen(mt, p)));
+    models.push_back(model);
+  }
+
+  UCTPlannerParams params;
+  params.reward_bound = reward_bound;
+  params.max_planning_time = planning_time;
+
+  boost::shared_ptr<SearchPlanner<StateIROS14, ActionIROS14> > planner;
+  if (tree_parallel) {
+    planner.reset(new TreeParallelUCTPlanner<StateIROS14, ActionIROS14>(
+          models, params, -reward_bound, 0));
+  } else {
+    planner.reset(new RootParallelUCTPlanner<StateIROS14, ActionIROS14>(
+          models, params, 0));
+  }
+  return planner;
+}
+
+int processOptions(int argc, char** argv) {
+
+  namespace po = boost::program_options;
+  po::options_description desc("Options");
+  desc.add_options()
+    ("map-file,M", po::value<std::string>(&map_file)->required(), "YAML map file")
+    ("graph-file,G", po::value<std::string>(&graph_file)->required(), "YAML graph file")
+    ("start-idx,s", po::value<int>(&start_idx), "Start index location")
+    ("goal-idx,g", po::value<int>(&goal_idx), "Goal index location")
+    ("max-threads,t", po::value<int>(&max_threads),
+     "Maximum number of threads (defaults to the number of cores)")
+    ("planning-time,p", po::value<float>(&planning_time),
+     "Planning time per measurement (in seconds)");
+
+  po::variables_map vm;
+
+  try {
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+  } catch(boost::program_options::error& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+    std::cout << desc << std::endl;
+    return -1;
+  }
+
+  if (max_threads <= 0) {
+    max_threads = boost::thread::hardware_concurrency();
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv) {
+
+  int ret = processOptions(argc, argv);
+  if (ret != 0) {
+    return ret;
+  }
+
+  bwi_mapper::MapLoader mapper(map_file);
+  bwi_mapper::Graph graph;
+  nav_msgs::OccupancyGrid map;
+  mapper.getMap(map);
+  bwi_mapper::readGraphFromFile(graph_file, map.info, graph);
+
+  boost::shared_ptr<PersonModelIROS14> base_model(
+      new PersonModelIROS14(graph, map, goal_idx));
+
+  // Needed to pick the goals of the robots added to the start state. Every
+  // planner thread gets its own generators in createPlanner.
+  boost::mt19937 mt(0);
+  boost::uniform_int<int> i(0, boost::num_vertices(graph) - 1);
+  boost::uniform_real<float> u(0.0f, 1.0f);
+  boost::poisson_distribution<int> p(1);
+  base_model->initializeRNG(UIGenPtr(new UIGen(mt, i)),
+      URGenPtr(new URGen(mt, u)), PIGenPtr(new PIGen(mt, p)));
+
+  StateIROS14 start_state;
+  start_state.graph_id = start_idx;
+  start_state.direction = 0;
+  start_state.precision = 1.0f;
+  start_state.from_graph_node = start_idx;
+  start_state.robot_gave_direction = false;
+  base_model->addRobots(start_state, MAX_ROBOTS_IROS14);
+
+  for (int tree_parallel = 1; tree_parallel >= 0; --tree_parallel) {
+    std::cout << ((tree_parallel) ? "Tree" : "Root") << " parallel UCT:" <<
+      std::endl;
+    float single_thread_rate = 0.0f;
+    for (int num_threads = 1; num_threads <= max_threads; ++num_threads) {
+      std::vector<boost::shared_ptr<boost::mt19937> > mts;
+      boost::shared_ptr<SearchPlanner<StateIROS14, ActionIROS14> > planner =
+        createPlanner(tree_parallel, num_threads, base_model, mts, graph);
+      unsigned int terminations;
+      unsigned int playouts = planner->search(start_state, terminations);
+      float rate = playouts / planning_time;
+      if (num_threads == 1) {
+        single_thread_rate = rate;
+      }
+      std::cout << "  " << num_threads << " threads: " << rate <<
+        " playouts/s (x" << rate / single_thread_rate << "), best action " <<
+        planner->selectWorldAction(start_state) << std::endl;
+    }
+  }
+
+  return 0;
+}